@@ -104,6 +104,47 @@ static uint16_t StartAddr = 0x0000;
  */
 static uint16_t EndAddr = 0x0000;
 
+/** Flash operation statistics, readable by the host one byte at a time with the
+ * Read Bootloader Info command from index \ref BOOTLOADER_STATS_INDEX upwards.
+ */
+static BootloaderStats_t Stats;
+
+/** RAM copies of flash pages. While one page is erased and written in the
+ * background, the next one is downloaded into the other buffer. Pages are
+ * compared against the flash contents before they are committed, so unchanged
+ * pages are never erased or written.
+ */
+static PageBuffer_t PageBuffers[2];
+
+/** Page buffer the download is currently staged into. */
+static PageBuffer_t *ReceiveBuffer = &PageBuffers[0];
+
+/** Page buffer being programmed into flash, while \ref FlashState isn't
+ * \ref FLASH_IDLE.
+ */
+static PageBuffer_t *ProgramBuffer;
+
+/** State of the background programming of \ref ProgramBuffer, one of the
+ * values in the FlashState_t enum.
+ */
+static uint8_t FlashState = FLASH_IDLE;
+
+/** Flash address of the page being programmed in the background. */
+static uint32_t FlashPageAddress;
+
+/** Flag to indicate that the page being programmed is blank, so that it is
+ * complete once erased.
+ */
+static bool FlashPageBlank;
+
+#if COMPRESSED_DOWNLOADS
+/** Most recently decompressed bytes of a compressed flash download, which
+ * matches in the stream copy from. Indexed by an 8-bit position, so it wraps
+ * around by itself.
+ */
+static uint8_t DecompressWindow[COMPRESSED_WINDOW_SIZE];
+#endif
+
 /** Magic lock for forced application start. If the HWBE fuse is programmed and
  * BOOTRST is unprogrammed, the bootloader will start if the /HWB line of the
  * AVR is held low and the system is reset. However, if the /HWB line is still
@@ -129,8 +170,12 @@ int main(void) {
   /* Run the USB management task while the bootloader is supposed to be running
    */
   // while (RunBootloader || WaitForExit)
-  while (1)
+  while (1) {
     USB_USBTask();
+
+    /* Finish programming the last downloaded page in between requests */
+    ServiceFlashPage();
+  }
 }
 
 /** Configures all hardware required for the bootloader. */
@@ -222,58 +267,73 @@ void EVENT_USB_Device_ControlRequest(void) {
 
         if (IS_ONEBYTE_COMMAND(SentCommand.Data, 0x00)) // Write flash
         {
-          /* Calculate the number of words to be written from the number of
-           * bytes to be written */
-          uint16_t WordsRemaining = (BytesRemaining >> 1);
+          /* Flash is programmed in whole words, drop an odd trailing byte */
+          BytesRemaining &= ~1;
 
           union {
             uint16_t Words[2];
             uint32_t Long;
           } CurrFlashAddress = {.Words = {StartAddr, Flash64KBPage}};
 
-          uint32_t CurrFlashPageStartAddress = CurrFlashAddress.Long;
-          uint8_t WordsInFlashPage = 0;
+          uint16_t PageOffset = (CurrFlashAddress.Words[0] % SPM_PAGESIZE);
+          CurrFlashAddress.Long -= PageOffset;
+
+          ClearPageBuffer();
 
-          while (WordsRemaining--) {
+          while (BytesRemaining) {
             /* Check if endpoint is empty - if so clear it and wait until ready
-             * for next packet */
+             * for next packet, programming the previous page meanwhile */
             if (!(Endpoint_BytesInEndpoint())) {
               Endpoint_ClearOUT();
 
               while (!(Endpoint_IsOUTReceived())) {
                 if (USB_DeviceState == DEVICE_STATE_Unattached)
                   return;
+
+                ServiceFlashPage();
               }
             }
 
-            /* Write the next word into the current flash page */
-            BootloaderAPI_FillWord(CurrFlashAddress.Long,
-                                   Endpoint_Read_16_LE());
+            /* Copy as much of the packet as fits the current flash page */
+            uint16_t BytesToCopy = Endpoint_BytesInEndpoint();
+
+            if (BytesToCopy > (SPM_PAGESIZE - PageOffset))
+              BytesToCopy = (SPM_PAGESIZE - PageOffset);
+            if (BytesToCopy > BytesRemaining)
+              BytesToCopy = BytesRemaining;
+
+            uint8_t *PageData = &ReceiveBuffer->Bytes[PageOffset];
 
             /* Adjust counters */
-            WordsInFlashPage += 1;
-            CurrFlashAddress.Long += 2;
+            PageOffset += BytesToCopy;
+            BytesRemaining -= BytesToCopy;
 
-            /* See if an entire page has been written to the flash page buffer
-             */
-            if ((WordsInFlashPage == (SPM_PAGESIZE >> 1)) ||
-                !(WordsRemaining)) {
-              /* Commit the flash page to memory */
-              BootloaderAPI_WritePage(CurrFlashPageStartAddress);
-
-              /* Check if programming incomplete */
-              if (WordsRemaining) {
-                CurrFlashPageStartAddress = CurrFlashAddress.Long;
-                WordsInFlashPage = 0;
-
-                /* Erase next page's temp buffer */
-                BootloaderAPI_ErasePage(CurrFlashAddress.Long);
-              }
+            while (BytesToCopy--)
+              *(PageData++) = Endpoint_Read_8();
+
+            /* See if the end of the page or of the data has been reached */
+            if ((PageOffset == SPM_PAGESIZE) || !(BytesRemaining)) {
+              /* Commit the staged page to memory, if it differs from it */
+              CommitFlashPage(CurrFlashAddress.Long);
+
+              CurrFlashAddress.Long += SPM_PAGESIZE;
+              PageOffset = 0;
+
+              ClearPageBuffer();
             }
           }
 
           /* Once programming complete, start address equals the end address */
           StartAddr = EndAddr;
+#if COMPRESSED_DOWNLOADS
+        } else if (IS_ONEBYTE_COMMAND(SentCommand.Data,
+                                      COMPRESSED_FLASH_MEMORY)) // Write flash
+        {
+          DecompressFlashData(BytesRemaining);
+
+          /* Once programming complete, start address equals the end address */
+          StartAddr = EndAddr;
+#endif
         } else // Write EEPROM
         {
           while (BytesRemaining--) {
@@ -310,6 +370,9 @@ void EVENT_USB_Device_ControlRequest(void) {
   case DFU_REQ_UPLOAD:
     Endpoint_ClearSETUP();
 
+    /* Flash can't be read back while a page is being programmed */
+    FinishFlashPage();
+
     while (!(Endpoint_IsINReady())) {
       if (USB_DeviceState == DEVICE_STATE_Unattached)
         return;
@@ -367,6 +430,35 @@ void EVENT_USB_Device_ControlRequest(void) {
 
         /* Once reading is complete, start address equals the end address */
         StartAddr = EndAddr;
+#if PAGE_CRC_READS
+      } else if (IS_ONEBYTE_COMMAND(SentCommand.Data,
+                                    PAGE_CRC_MEMORY)) // Read page CRCs
+      {
+        /* Each page CRC is a word, the addresses index into the CRC list */
+        uint16_t WordsRemaining = (BytesRemaining >> 1);
+        uint32_t PageAddress = ((uint32_t)(StartAddr >> 1) * SPM_PAGESIZE);
+
+        while (WordsRemaining--) {
+          /* Check if endpoint is full - if so clear it and wait until ready for
+           * next packet */
+          if (Endpoint_BytesInEndpoint() == FIXED_CONTROL_ENDPOINT_SIZE) {
+            Endpoint_ClearIN();
+
+            while (!(Endpoint_IsINReady())) {
+              if (USB_DeviceState == DEVICE_STATE_Unattached)
+                return;
+            }
+          }
+
+          Endpoint_Write_16_LE(FlashPageCRC16(PageAddress));
+
+          /* Adjust counters */
+          PageAddress += SPM_PAGESIZE;
+        }
+
+        /* Once reading is complete, start address equals the end address */
+        StartAddr = EndAddr;
+#endif
       } else if (IS_ONEBYTE_COMMAND(SentCommand.Data, 0x02)) // Read EEPROM
       {
         while (BytesRemaining--) {
@@ -408,8 +500,15 @@ void EVENT_USB_Device_ControlRequest(void) {
     /* Write 8-bit status value */
     Endpoint_Write_8(DFU_Status);
 
-    /* Write 24-bit poll timeout value */
-    Endpoint_Write_8(0);
+    /* Write 24-bit poll timeout value, the time until a page still being
+     * programmed in the background is done */
+    if (FlashState == FLASH_ERASING)
+      Endpoint_Write_8(FlashPageBlank ? FLASH_PAGE_PROGRAM_MS
+                                      : (2 * FLASH_PAGE_PROGRAM_MS));
+    else if (FlashState == FLASH_WRITING)
+      Endpoint_Write_8(FLASH_PAGE_PROGRAM_MS);
+    else
+      Endpoint_Write_8(0);
     Endpoint_Write_16_LE(0);
 
     /* Write 8-bit state value */
@@ -464,7 +563,7 @@ void EVENT_USB_Device_ControlRequest(void) {
  * control endpoint
  */
 static void DiscardFillerBytes(uint8_t NumberOfBytes) {
-  while (NumberOfBytes--) {
+  while (NumberOfBytes) {
     if (!(Endpoint_BytesInEndpoint())) {
       Endpoint_ClearOUT();
 
@@ -472,9 +571,12 @@ static void DiscardFillerBytes(uint8_t NumberOfBytes) {
       while (!(Endpoint_IsOUTReceived())) {
         if (USB_DeviceState == DEVICE_STATE_Unattached)
           return;
+
+        ServiceFlashPage();
       }
     } else {
       Endpoint_Discard_8();
+      NumberOfBytes--;
     }
   }
 }
@@ -485,6 +587,9 @@ static void DiscardFillerBytes(uint8_t NumberOfBytes) {
  * handler function.
  */
 static void ProcessBootloaderCommand(void) {
+  /* Complete any page still being programmed before acting on a new command */
+  FinishFlashPage();
+
   /* Check if device is in secure mode */
   if (IsSecure) {
     /* Don't process command unless it is a READ or chip erase command */
@@ -545,25 +650,26 @@ static void LoadStartEndAddresses(void) {
 
 /** Handler for a Memory Program command issued by the host. This routine
  * handles the preparations needed to write subsequent data from the host into
- * the specified memory.
+ * the specified memory. Flash ranges reaching into the bootloader section are
+ * rejected, the pages are erased and written without further checks.
  */
 static void ProcessMemProgCommand(void) {
   if (IS_ONEBYTE_COMMAND(SentCommand.Data, 0x00) || // Write FLASH command
-      IS_ONEBYTE_COMMAND(SentCommand.Data, 0x01))   // Write EEPROM command
+#if COMPRESSED_DOWNLOADS
+      IS_ONEBYTE_COMMAND(SentCommand.Data, COMPRESSED_FLASH_MEMORY) ||
+#endif
+      IS_ONEBYTE_COMMAND(SentCommand.Data, 0x01)) // Write EEPROM command
   {
     /* Load in the start and ending read addresses */
     LoadStartEndAddresses();
 
-    /* If FLASH is being written to, we need to pre-erase the first page to
-     * write to */
-    if (IS_ONEBYTE_COMMAND(SentCommand.Data, 0x00)) {
-      union {
-        uint16_t Words[2];
-        uint32_t Long;
-      } CurrFlashAddress = {.Words = {StartAddr, Flash64KBPage}};
-
-      /* Erase the current page's temp buffer */
-      BootloaderAPI_ErasePage(CurrFlashAddress.Long);
+    if (!(IS_ONEBYTE_COMMAND(SentCommand.Data, 0x01))) {
+      if (!(IsFlashRangeValid(Flash64KBPage, StartAddr, EndAddr))) {
+        /* Set the state and status variables to indicate the error */
+        DFU_State = dfuERROR;
+        DFU_Status = errADDRESS;
+        return;
+      }
     }
 
     /* Set the state so that the next DNLOAD requests reads in the firmware */
@@ -577,39 +683,55 @@ static void ProcessMemProgCommand(void) {
  */
 static void ProcessMemReadCommand(void) {
   if (IS_ONEBYTE_COMMAND(SentCommand.Data, 0x00) || // Read FLASH command
-      IS_ONEBYTE_COMMAND(SentCommand.Data, 0x02))   // Read EEPROM command
+#if PAGE_CRC_READS
+      IS_ONEBYTE_COMMAND(SentCommand.Data, PAGE_CRC_MEMORY) ||
+#endif
+      IS_ONEBYTE_COMMAND(SentCommand.Data, 0x02)) // Read EEPROM command
   {
     /* Load in the start and ending read addresses */
     LoadStartEndAddresses();
 
+#if PAGE_CRC_READS
+    /* The page CRCs only cover the application section */
+    if (IS_ONEBYTE_COMMAND(SentCommand.Data, PAGE_CRC_MEMORY) &&
+        ((StartAddr > EndAddr) ||
+         (EndAddr >= (APPLICATION_PAGES * sizeof(uint16_t))))) {
+      /* Set the state and status variables to indicate the error */
+      DFU_State = dfuERROR;
+      DFU_Status = errADDRESS;
+      return;
+    }
+#endif
+
     /* Set the state so that the next UPLOAD requests read out the firmware */
     DFU_State = dfuUPLOAD_IDLE;
   } else if (IS_ONEBYTE_COMMAND(SentCommand.Data,
                                 0x01)) // Blank check FLASH command
   {
-    uint32_t CurrFlashAddress = 0;
+    for (uint32_t CurrFlashAddress = 0;
+         CurrFlashAddress < (uint32_t)BOOT_START_ADDR;
+         CurrFlashAddress += SPM_PAGESIZE) {
+      if (IsPageBlank(CurrFlashAddress))
+        continue;
 
-    while (CurrFlashAddress < (uint32_t)BOOT_START_ADDR) {
-/* Check if the current byte is not blank */
+/* Locate the first non-blank byte within the page */
 #if (FLASHEND > 0xFFFF)
-      if (pgm_read_byte_far(CurrFlashAddress) != 0xFF)
+      while (pgm_read_byte_far(CurrFlashAddress) == 0xFF)
 #else
-      if (pgm_read_byte(CurrFlashAddress) != 0xFF)
+      while (pgm_read_byte(CurrFlashAddress) == 0xFF)
 #endif
-      {
-        /* Save the location of the first non-blank byte for response back to
-         * the host */
-        Flash64KBPage = (CurrFlashAddress >> 16);
-        StartAddr = CurrFlashAddress;
+        CurrFlashAddress++;
 
-        /* Set state and status variables to the appropriate error values */
-        DFU_State = dfuERROR;
-        DFU_Status = errCHECK_ERASED;
+      /* Save the location of the first non-blank byte for response back to
+       * the host */
+      Flash64KBPage = (CurrFlashAddress >> 16);
+      StartAddr = CurrFlashAddress;
 
-        break;
-      }
+      /* Set state and status variables to the appropriate error values */
+      DFU_State = dfuERROR;
+      DFU_Status = errCHECK_ERASED;
 
-      CurrFlashAddress++;
+      break;
     }
   }
 }
@@ -658,11 +780,30 @@ static void ProcessWriteCommand(void) {
     }
   } else if (IS_TWOBYTE_COMMAND(SentCommand.Data, 0x00, 0xFF)) // Erase flash
   {
-    /* Clear the application section of flash */
+    /* A new image starts with the erase, clear all statistics */
+    memset(&Stats, 0, sizeof(Stats));
+
+    /* Time the erase with timer 1, which the bootloader doesn't otherwise use
+     */
+    TCNT1 = 0;
+    TCCR1B = BOOTLOADER_TIMER_PRESCALER;
+
+    /* Clear the application section of flash, skipping pages that are already
+     * blank */
     for (uint32_t CurrFlashAddress = 0;
          CurrFlashAddress < (uint32_t)BOOT_START_ADDR;
-         CurrFlashAddress += SPM_PAGESIZE)
+         CurrFlashAddress += SPM_PAGESIZE) {
+      if (IsPageBlank(CurrFlashAddress)) {
+        Stats.BlankPages++;
+        continue;
+      }
+
       BootloaderAPI_ErasePage(CurrFlashAddress);
+      Stats.ErasedPages++;
+    }
+
+    Stats.EraseTime = TCNT1;
+    TCCR1B = 0;
 
     /* Memory has been erased, reset the security bit so that
      * programming/reading is allowed */
@@ -687,6 +828,10 @@ static void ProcessReadCommand(void) {
   {
     if (DataIndexToRead < 3)
       ResponseByte = BootloaderInfo[DataIndexToRead];
+    else if ((uint8_t)(DataIndexToRead - BOOTLOADER_STATS_INDEX) <
+             sizeof(Stats))
+      ResponseByte =
+          ((uint8_t *)&Stats)[DataIndexToRead - BOOTLOADER_STATS_INDEX];
     else
       ReadAddressInvalid = true;
   } else if (IS_ONEBYTE_COMMAND(SentCommand.Data, 0x01)) // Read signature byte
@@ -716,3 +861,256 @@ static void ProcessReadCommand(void) {
     DFU_Status = errADDRESS;
   }
 }
+
+/** Fills the RAM page buffer with the erased flash value, so that the parts of
+ * a page the host doesn't send end up blank as they would after a page erase.
+ */
+static void ClearPageBuffer(void) {
+  memset(ReceiveBuffer->Bytes, 0xFF, SPM_PAGESIZE);
+}
+
+/** Commits the RAM page buffer to a flash page. Pages whose contents already
+ * match the buffer are skipped entirely, and pages that become blank are only
+ * erased, not written. Otherwise the page erase is started and the buffers are
+ * swapped, so the next page can be downloaded while \ref ServiceFlashPage()
+ * completes this one from the RWW section.
+ *
+ *  \param[in] PageAddress  Address of the first byte of the page to commit
+ */
+static void CommitFlashPage(const uint32_t PageAddress) {
+  bool PageMatches = true;
+  uint8_t Accumulator = 0xFF;
+
+  /* The previous page must be done before the flash can be read to compare */
+  FinishFlashPage();
+
+  for (uint16_t Offset = 0; Offset < SPM_PAGESIZE; Offset++) {
+    uint8_t Byte = ReceiveBuffer->Bytes[Offset];
+
+#if (FLASHEND > 0xFFFF)
+    if (pgm_read_byte_far(PageAddress + Offset) != Byte)
+#else
+    if (pgm_read_byte(PageAddress + Offset) != Byte)
+#endif
+      PageMatches = false;
+
+    Accumulator &= Byte;
+  }
+
+  if (PageMatches) {
+    Stats.SkippedPages++;
+    return;
+  }
+
+  /* Never erase the bootloader itself, whatever the command checks let by */
+  if (!(IsApplicationPage(PageAddress))) {
+    DFU_State = dfuERROR;
+    DFU_Status = errADDRESS;
+    return;
+  }
+
+  /* A blank page is complete once erased */
+  FlashPageBlank = (Accumulator == 0xFF);
+  if (FlashPageBlank)
+    Stats.ClearedPages++;
+  else
+    Stats.WrittenPages++;
+
+  ProgramBuffer = ReceiveBuffer;
+  ReceiveBuffer = (ReceiveBuffer == &PageBuffers[0]) ? &PageBuffers[1]
+                                                      : &PageBuffers[0];
+  FlashPageAddress = PageAddress;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { boot_page_erase(PageAddress); }
+  FlashState = FLASH_ERASING;
+
+#if !PIPELINED_PROGRAMMING
+  FinishFlashPage();
+#endif
+}
+
+/** Advances the background programming of a flash page, without waiting for the
+ * SPM operation in progress. Once the page erase is done the SPM page buffer is
+ * filled and the page write started, and once that is done the RWW section is
+ * enabled for reading again.
+ */
+static void ServiceFlashPage(void) {
+  if ((FlashState == FLASH_IDLE) || boot_spm_busy())
+    return;
+
+  if ((FlashState == FLASH_ERASING) && !(FlashPageBlank)) {
+    if (IsApplicationPage(FlashPageAddress)) {
+      for (uint16_t Offset = 0; Offset < SPM_PAGESIZE; Offset += 2)
+        BootloaderAPI_FillWord(FlashPageAddress + Offset,
+                               ProgramBuffer->Words[Offset >> 1]);
+
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { boot_page_write(FlashPageAddress); }
+      FlashState = FLASH_WRITING;
+      return;
+    }
+
+    /* Never write the bootloader itself either, just end the operation */
+    DFU_State = dfuERROR;
+    DFU_Status = errADDRESS;
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { boot_rww_enable(); }
+  FlashState = FLASH_IDLE;
+}
+
+/** Waits until the page being programmed in the background, if any, is
+ * complete and the RWW section can be read again.
+ */
+static void FinishFlashPage(void) {
+  while (FlashState != FLASH_IDLE)
+    ServiceFlashPage();
+}
+
+#if COMPRESSED_DOWNLOADS
+/** Reads the next byte of a compressed flash download from the control
+ * endpoint, waiting for the next packet if needed and programming the previous
+ * page meanwhile.
+ *
+ *  \return Next byte of the compressed stream, or 0 if the device was unplugged
+ */
+static uint8_t ReadCompressedByte(void) {
+  if (!(Endpoint_BytesInEndpoint())) {
+    Endpoint_ClearOUT();
+
+    while (!(Endpoint_IsOUTReceived())) {
+      if (USB_DeviceState == DEVICE_STATE_Unattached)
+        return 0;
+
+      ServiceFlashPage();
+    }
+  }
+
+  return Endpoint_Read_8();
+}
+
+/** Decompresses a flash download into the RAM page buffer, committing each
+ * page as it is completed just like an uncompressed download. The stream is a
+ * sequence of literal runs and matches, see \ref COMPRESSED_MATCH_FLAG, and
+ * each DNLOAD request is compressed on its own.
+ *
+ *  \param[in] BytesRemaining  Number of decompressed bytes to program
+ */
+static void DecompressFlashData(uint16_t BytesRemaining) {
+  union {
+    uint16_t Words[2];
+    uint32_t Long;
+  } CurrFlashAddress = {.Words = {StartAddr, Flash64KBPage}};
+
+  uint16_t PageOffset = (CurrFlashAddress.Words[0] % SPM_PAGESIZE);
+  uint8_t WindowPosition = 0;
+  uint8_t Token = 0;
+  uint8_t MatchDistance = 0;
+  uint8_t BytesInToken = 0;
+
+  /* Flash is programmed in whole words, drop an odd trailing byte */
+  BytesRemaining &= ~1;
+  CurrFlashAddress.Long -= PageOffset;
+
+  ClearPageBuffer();
+
+  while (BytesRemaining) {
+    /* Fetch the next literal run or match once the last one is used up */
+    if (!(BytesInToken)) {
+      Token = ReadCompressedByte();
+
+      if (Token & COMPRESSED_MATCH_FLAG) {
+        BytesInToken =
+            ((Token & ~COMPRESSED_MATCH_FLAG) + COMPRESSED_MIN_MATCH);
+        MatchDistance = ReadCompressedByte();
+      } else {
+        BytesInToken = (Token + 1);
+      }
+    }
+
+    uint8_t Byte =
+        (Token & COMPRESSED_MATCH_FLAG)
+            ? DecompressWindow[(uint8_t)(WindowPosition - MatchDistance - 1)]
+            : ReadCompressedByte();
+
+    /* Don't commit pages made of whatever was read after an unplug */
+    if (USB_DeviceState == DEVICE_STATE_Unattached)
+      return;
+
+    /* Adjust counters */
+    BytesInToken--;
+    BytesRemaining--;
+
+    DecompressWindow[WindowPosition++] = Byte;
+    ReceiveBuffer->Bytes[PageOffset++] = Byte;
+
+    /* See if the end of the page or of the data has been reached */
+    if ((PageOffset == SPM_PAGESIZE) || !(BytesRemaining)) {
+      /* Commit the staged page to memory, if it differs from it */
+      CommitFlashPage(CurrFlashAddress.Long);
+
+      CurrFlashAddress.Long += SPM_PAGESIZE;
+      PageOffset = 0;
+
+      ClearPageBuffer();
+    }
+  }
+}
+#endif
+
+#if PAGE_CRC_READS
+/** Calculates the CRC-16 of a flash page as it is now, see
+ * \ref PAGE_CRC_MEMORY.
+ *
+ *  \param[in] PageAddress  Address of the first byte of the page
+ *
+ *  \return CRC-16 of the page contents
+ */
+static uint16_t FlashPageCRC16(const uint32_t PageAddress) {
+  uint16_t CRC = 0xFFFF;
+
+  for (uint16_t Offset = 0; Offset < SPM_PAGESIZE; Offset++)
+#if (FLASHEND > 0xFFFF)
+    CRC = _crc16_update(CRC, pgm_read_byte_far(PageAddress + Offset));
+#else
+    CRC = _crc16_update(CRC, pgm_read_byte(PageAddress + Offset));
+#endif
+
+  return CRC;
+}
+#endif
+
+/** Checks whether a flash page is blank, i.e. every byte in it reads 0xFF. The
+ * page is read a byte at a time with LPM and post-increment of the Z pointer,
+ * ANDing each byte into an accumulator, so there is no compare or branch per
+ * byte beyond the loop itself.
+ *
+ *  \param[in] PageAddress  Address of the first byte of the page to check
+ *
+ *  \return Boolean \c true if the page is blank, \c false otherwise
+ */
+static bool IsPageBlank(const uint32_t PageAddress) {
+#if (FLASHEND > 0xFFFF)
+  uint8_t Accumulator = 0xFF;
+
+  for (uint16_t Offset = 0; Offset < SPM_PAGESIZE; Offset++)
+    Accumulator &= pgm_read_byte_far(PageAddress + Offset);
+
+  return (Accumulator == 0xFF);
+#else
+  uint16_t Address = PageAddress;
+  uint8_t Accumulator = 0xFF;
+  uint8_t Count = (SPM_PAGESIZE / 2);
+  uint8_t Byte;
+
+  __asm__ __volatile__("1: lpm  %[byte], Z+      \n\t"
+                       "   and  %[acc], %[byte]  \n\t"
+                       "   lpm  %[byte], Z+      \n\t"
+                       "   and  %[acc], %[byte]  \n\t"
+                       "   dec  %[count]         \n\t"
+                       "   brne 1b               \n\t"
+                       : [acc] "+r"(Accumulator), [byte] "=&r"(Byte),
+                         [count] "+r"(Count), "+z"(Address));
+
+  return (Accumulator == 0xFF);
+#endif
+}
@@ -45,11 +45,14 @@
 #include <avr/power.h>
 #include <avr/wdt.h>
 #include <stdbool.h>
+#include <string.h>
+#include <util/crc16.h>
 #include <util/delay.h>
 
 #include "BootloaderAPI.h"
 #include "Config/AppConfig.h"
 #include "Descriptors.h"
+#include "FlashRange.h"
 
 #include <LUFA/Drivers/Board/LEDs.h>
 #include <LUFA/Drivers/USB/USB.h>
@@ -84,6 +87,21 @@
  * device's bootloader. */
 #define BOOTLOADER_ID_BYTE2 0xFB
 
+/** Read Bootloader Info index of the first byte of the \ref BootloaderStats_t
+ * statistics. Indices below this are the version and identification bytes.
+ */
+#define BOOTLOADER_STATS_INDEX 0x10
+
+/** Worst case duration of a flash page erase or write in milliseconds, used to
+ * tell the host how long to wait for a page programmed in the background.
+ */
+#define FLASH_PAGE_PROGRAM_MS 5
+
+/** Timer 1 clock select used to time flash operations, clk/1024. At 16MHz one
+ * timer tick is 64us, and the 16-bit counter covers a little over 4 seconds.
+ */
+#define BOOTLOADER_TIMER_PRESCALER ((1 << CS12) | (1 << CS10))
+
 /** Convenience macro, used to determine if the issued command is the given
  * one-byte long command.
  *
@@ -115,6 +133,37 @@
  */
 #define DFU_FILLER_BYTES_SIZE 26
 
+/** Memory type of a Memory Program command, besides 0x00 for FLASH and 0x01
+ * for EEPROM, for FLASH data sent compressed. The start and end addresses are
+ * those of the decompressed data.
+ */
+#define COMPRESSED_FLASH_MEMORY 0x80
+
+/** Token flag of a match in compressed FLASH data. A token without it starts a
+ * literal run of (token + 1) bytes, which follow it. A token with it copies
+ * ((token & 0x7F) + \ref COMPRESSED_MIN_MATCH) bytes from (d + 1) bytes back
+ * in the decompressed data, with d the byte following the token.
+ */
+#define COMPRESSED_MATCH_FLAG 0x80
+
+/** Length of the shortest match in compressed FLASH data. */
+#define COMPRESSED_MIN_MATCH 3
+
+/** Size of the window of decompressed data matches can reach back into. */
+#define COMPRESSED_WINDOW_SIZE 256
+
+/** Memory type of a Display Data command, besides 0x00 for FLASH, 0x01 for
+ * the FLASH blank check and 0x02 for EEPROM, to read the CRC-16
+ * (\c _crc16_update(), initial value 0xFFFF) of each application page as it
+ * is in flash. The addresses are byte offsets into the list of little endian
+ * CRCs, one per page. An interrupted download can be resumed by sending only
+ * the pages whose CRCs don't match the image.
+ */
+#define PAGE_CRC_MEMORY 0x81
+
+/** Number of flash pages in the application section. */
+#define APPLICATION_PAGES (BOOT_START_ADDR / SPM_PAGESIZE)
+
 /** DFU class command request to detach from the host. */
 #define DFU_REQ_DETATCH 0x00
 
@@ -169,6 +218,29 @@ typedef struct {
   uint16_t DataSize; /**< Size of the command parameters */
 } DFU_Command_t;
 
+/** Type define for the flash operation statistics kept by the bootloader, read
+ * back by the host through the Read Bootloader Info command. The download
+ * counters run from bootloader start or the last chip erase. All multi-byte
+ * values are little endian.
+ */
+typedef struct {
+  uint8_t ErasedPages; /**< Pages erased by the last chip erase */
+  uint8_t BlankPages;  /**< Pages the last chip erase skipped as blank */
+  uint16_t EraseTime;  /**< Duration of the last chip erase, in timer ticks of
+                          1024 clock cycles */
+  uint16_t WrittenPages; /**< Pages erased and written by downloads */
+  uint16_t SkippedPages; /**< Pages downloads left alone, as flash already held
+                            the data */
+  uint16_t ClearedPages; /**< Pages downloads erased without writing, as the
+                            data was all 0xFF */
+} BootloaderStats_t;
+
+/** Type define for a RAM copy of a flash page. */
+typedef union {
+  uint8_t Bytes[SPM_PAGESIZE];      /**< Page contents as bytes */
+  uint16_t Words[SPM_PAGESIZE / 2]; /**< Page contents as flash words */
+} PageBuffer_t;
+
 /* Enums: */
 /** DFU bootloader states. Refer to the DFU class specification for information
  * on each state. */
@@ -186,6 +258,13 @@ enum DFU_State_t {
   dfuERROR = 10
 };
 
+/** States of the background programming of a flash page. */
+enum FlashState_t {
+  FLASH_IDLE = 0,    /**< No page being programmed, flash can be read */
+  FLASH_ERASING = 1, /**< Page erase in progress */
+  FLASH_WRITING = 2  /**< Page write in progress */
+};
+
 /** DFU command status error codes. Refer to the DFU class specification for
  * information on each error code. */
 enum DFU_Status_t {
@@ -220,6 +299,18 @@ static void ProcessMemProgCommand(void);
 static void ProcessMemReadCommand(void);
 static void ProcessWriteCommand(void);
 static void ProcessReadCommand(void);
+static void ClearPageBuffer(void);
+static void CommitFlashPage(const uint32_t PageAddress);
+static void ServiceFlashPage(void);
+static void FinishFlashPage(void);
+#if COMPRESSED_DOWNLOADS
+static uint8_t ReadCompressedByte(void);
+static void DecompressFlashData(uint16_t BytesRemaining);
+#endif
+#if PAGE_CRC_READS
+static uint16_t FlashPageCRC16(const uint32_t PageAddress);
+#endif
+static bool IsPageBlank(const uint32_t PageAddress);
 #endif
 
 void Application_Jump_Check(void) ATTR_INIT_SECTION(3);
@@ -45,4 +45,19 @@
 
 #define SECURE_MODE false
 
+/* Program each downloaded flash page in the background while the next one is
+ * received. Set to false for the blocking path, to compare transfer rates. */
+#define PIPELINED_PROGRAMMING true
+
+/* Optional host extensions. The bootloader has to stay within its 4KB section:
+ * if it outgrows it, .text runs into the API tables at the end of flash and the
+ * link fails. "make size" prints how much room is left.
+ *
+ * COMPRESSED_DOWNLOADS: flash downloads of memory type 0x80, compressed, at
+ * the cost of a 256 byte RAM window.
+ * PAGE_CRC_READS: Display Data of memory type 0x81, the CRC-16 of each
+ * application page, to resume interrupted downloads. */
+#define COMPRESSED_DOWNLOADS true
+#define PAGE_CRC_READS true
+
 #endif
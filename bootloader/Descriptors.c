@@ -104,7 +104,7 @@ const USB_Descriptor_Configuration_t ConfigurationDescriptor = {
         .Attributes = (ATTR_CAN_UPLOAD | ATTR_CAN_DOWNLOAD),
 
         .DetachTimeout = 0x0000,
-        .TransferSize = 0x0C00,
+        .TransferSize = DFU_TRANSFER_SIZE,
 
         .DFUSpecification = VERSION_BCD(1, 1, 0)}};
 
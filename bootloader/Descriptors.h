@@ -66,6 +66,12 @@
  */
 #define ATTR_CAN_DOWNLOAD (1 << 0)
 
+/** Maximum number of bytes the DFU device accepts in one DNLOAD request, a
+ * whole number of flash pages. A host sends one page less of image data per
+ * request, leaving room for the command header and file suffix.
+ */
+#define DFU_TRANSFER_SIZE (32 * SPM_PAGESIZE)
+
 #if defined(__AVR_AT90USB1287__)
 #define PRODUCT_ID_CODE 0x2FFB
 #define AVR_SIGNATURE_1 0x1E
@@ -0,0 +1,46 @@
+/** \file
+ *
+ *  Address checks of the flash operations of the bootloader. These depend on
+ *  nothing but \c BOOT_START_ADDR, so they can also be built and tested on the
+ *  host, see host/flash_range_test.c.
+ */
+
+#ifndef _FLASH_RANGE_H_
+#define _FLASH_RANGE_H_
+
+/* Includes: */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Inline Functions: */
+/** Checks the address range of a Memory Program command for FLASH. The range
+ * must not be empty and must end below the bootloader section, whose pages the
+ * bootloader must never erase or write.
+ *
+ *  \param[in] Flash64KBPage  Current 64KB flash page of the addresses
+ *  \param[in] StartAddr      Address of the first byte to program
+ *  \param[in] EndAddr        Address of the last byte to program
+ *
+ *  \return Boolean \c true if the range can be programmed, \c false otherwise
+ */
+static inline bool IsFlashRangeValid(const uint8_t Flash64KBPage,
+                                     const uint16_t StartAddr,
+                                     const uint16_t EndAddr) {
+  uint32_t EndFlashAddress = (((uint32_t)Flash64KBPage << 16) | EndAddr);
+
+  return (StartAddr <= EndAddr) &&
+         (EndFlashAddress < (uint32_t)BOOT_START_ADDR);
+}
+
+/** Checks that a flash page lies in the application section, before it is
+ * erased or written with SPM.
+ *
+ *  \param[in] PageAddress  Address of the first byte of the page
+ *
+ *  \return Boolean \c true if the page may be programmed, \c false otherwise
+ */
+static inline bool IsApplicationPage(const uint32_t PageAddress) {
+  return (PageAddress < (uint32_t)BOOT_START_ADDR);
+}
+
+#endif
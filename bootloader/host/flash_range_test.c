@@ -0,0 +1,107 @@
+/** \file
+ *
+ *  Host test of the flash address checks in FlashRange.h, at the end of the
+ *  application section. The page walk mirrors the FLASH download loop of
+ *  EVENT_USB_Device_ControlRequest(), without the USB and SPM parts.
+ */
+
+#include <stdio.h>
+
+#include "FlashRange.h"
+
+#define SPM_PAGESIZE 128
+
+/** Bytes per control OUT packet, FIXED_CONTROL_ENDPOINT_SIZE. */
+#define PACKET_SIZE 32
+
+static int Failures;
+
+static void Check(const bool Condition, const char *Description) {
+  if (!(Condition)) {
+    printf("FAIL %s\n", Description);
+    Failures++;
+  }
+}
+
+/** Walks the pages a FLASH download of the range commits, as the bootloader
+ * does, and checks each one against \ref IsApplicationPage().
+ *
+ *  \return Number of pages committed, or -1 if one of them was refused
+ */
+static int DownloadPages(const uint16_t StartAddr, const uint16_t EndAddr,
+                         uint32_t *LastPage) {
+  uint16_t BytesRemaining = (((EndAddr - StartAddr) + 1) & ~1);
+  uint32_t CurrFlashAddress = StartAddr;
+  uint16_t PageOffset = (CurrFlashAddress % SPM_PAGESIZE);
+  uint16_t PacketBytes = 0;
+  int Pages = 0;
+
+  CurrFlashAddress -= PageOffset;
+
+  /* The program data starts aligned to the control endpoint */
+  PacketBytes = PACKET_SIZE - (StartAddr % PACKET_SIZE);
+
+  while (BytesRemaining) {
+    if (!(PacketBytes))
+      PacketBytes = PACKET_SIZE;
+
+    uint16_t BytesToCopy = PacketBytes;
+
+    if (BytesToCopy > (SPM_PAGESIZE - PageOffset))
+      BytesToCopy = (SPM_PAGESIZE - PageOffset);
+    if (BytesToCopy > BytesRemaining)
+      BytesToCopy = BytesRemaining;
+
+    PageOffset += BytesToCopy;
+    BytesRemaining -= BytesToCopy;
+    PacketBytes -= BytesToCopy;
+
+    if ((PageOffset == SPM_PAGESIZE) || !(BytesRemaining)) {
+      if (!(IsApplicationPage(CurrFlashAddress)))
+        return -1;
+
+      *LastPage = CurrFlashAddress;
+      Pages++;
+
+      CurrFlashAddress += SPM_PAGESIZE;
+      PageOffset = 0;
+    }
+  }
+
+  return Pages;
+}
+
+int main(void) {
+  const uint16_t LastByte = BOOT_START_ADDR - 1;
+  uint32_t LastPage = 0;
+
+  /* A download ending on the last application byte is accepted, and its
+   * pages stop right below the bootloader */
+  Check(IsFlashRangeValid(0, 0, LastByte), "whole application accepted");
+  Check(IsFlashRangeValid(0, LastByte - 1, LastByte), "last word accepted");
+  Check(DownloadPages(0, LastByte, &LastPage) == BOOT_START_ADDR / SPM_PAGESIZE,
+        "whole application commits every page");
+  Check(LastPage == BOOT_START_ADDR - SPM_PAGESIZE,
+        "whole application ends on the last page");
+  Check(DownloadPages(LastByte - 2 * SPM_PAGESIZE + 3, LastByte, &LastPage) ==
+            2,
+        "unaligned end download commits two pages");
+  Check(LastPage == BOOT_START_ADDR - SPM_PAGESIZE,
+        "unaligned end download ends on the last page");
+
+  /* One byte further reaches the bootloader */
+  Check(!(IsFlashRangeValid(0, 0, BOOT_START_ADDR)), "end at boot rejected");
+  Check(!(IsFlashRangeValid(0, BOOT_START_ADDR, BOOT_START_ADDR + 1)),
+        "range in boot rejected");
+  Check(!(IsFlashRangeValid(1, 0, 0)), "second 64KB page rejected");
+  Check(!(IsFlashRangeValid(0, 2, 1)), "reversed range rejected");
+
+  Check(IsApplicationPage(BOOT_START_ADDR - SPM_PAGESIZE),
+        "last application page programmable");
+  Check(!(IsApplicationPage(BOOT_START_ADDR)), "first boot page refused");
+  Check(DownloadPages(LastByte - 1, LastByte + 2, &LastPage) == -1,
+        "download into boot refused at the page");
+
+  printf("%s\n", Failures ? "FAILED" : "OK");
+  return Failures ? 1 : 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * Benchmark firmware for sim.c. It runs the gpio.c hot paths and whole CLI
+ * lines once each between two marker writes, then sleeps with interrupts off,
+ * which ends the simulation. USB is never started, command output goes to a
+ * write function that drops it after the formatting has been paid for.
+ */
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+
+#include "bench.h"
+#include "command.h"
+#include "gpio.h"
+
+#define BENCH_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+static volatile int16_t sink;
+
+static int discard_write(const char *s, size_t len) {
+  UNUSED(s);
+  return len;
+}
+
+static inline void bench_start(bench_case_t id) {
+  BENCH_BARRIER();
+  GPIOR1 = id;
+  BENCH_BARRIER();
+}
+
+static inline void bench_stop(void) {
+  BENCH_BARRIER();
+  GPIOR2 = 0;
+  BENCH_BARRIER();
+}
+
+static void bench_line(mcucli_t *cli, bench_case_t id, const char *line) {
+  bench_start(id);
+  while (*line != '\0') {
+    command_putc(cli, *line++);
+  }
+  command_putc(cli, '\r');
+  bench_stop();
+}
+
+int main(void) {
+  mcucli_t cli;
+
+  command_init(&cli, discard_write);
+  gpio_set_direction(GPIO_PB5, GPIO_DIRECTION_OUT);
+
+  bench_start(BENCH_EMPTY);
+  bench_stop();
+
+  bench_start(BENCH_GPIO_SET_LEVEL);
+  gpio_set_level(GPIO_PB5, 1);
+  bench_stop();
+
+  bench_start(BENCH_GPIO_GET_LEVEL);
+  sink = gpio_get_level(GPIO_PB5);
+  bench_stop();
+
+  bench_start(BENCH_GPIO_READ);
+  sink = gpio_read(GPIO_PINB);
+  bench_stop();
+
+  bench_start(BENCH_GPIO_WRITE);
+  gpio_write(GPIO_PORTB, 0x20);
+  bench_stop();
+
+  bench_line(&cli, BENCH_LINE_GPIO_PB5_1, "gpio PB5 1");
+  bench_line(&cli, BENCH_LINE_GPIO_ALL, "gpio all");
+
+  cli();
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  sleep_enable();
+  for (;;) {
+    sleep_cpu();
+  }
+}
@@ -0,0 +1,27 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+/*
+ * The benchmark cases, in the order bench.c runs them. The firmware writes the
+ * case number to GPIOR1 before a case and any value to GPIOR2 after it,
+ * sim.c reads the cycle counter of the simulated core on both writes. Case 0
+ * measures nothing and is subtracted from the others.
+ */
+#define BENCH_CASES(X)                                                         \
+  X(BENCH_EMPTY, "empty")                                                      \
+  X(BENCH_GPIO_SET_LEVEL, "gpio_set_level")                                    \
+  X(BENCH_GPIO_GET_LEVEL, "gpio_get_level")                                    \
+  X(BENCH_GPIO_READ, "gpio_read")                                              \
+  X(BENCH_GPIO_WRITE, "gpio_write")                                            \
+  X(BENCH_LINE_GPIO_PB5_1, "line:gpio PB5 1")                                  \
+  X(BENCH_LINE_GPIO_ALL, "line:gpio all")
+
+#define BENCH_ID(id, name) id,
+typedef enum { BENCH_CASES(BENCH_ID) BENCH_COUNT } bench_case_t;
+#undef BENCH_ID
+
+// GPIOR1 and GPIOR2, in data space as simavr addresses them
+#define BENCH_START_IO 0x4A
+#define BENCH_STOP_IO 0x4B
+
+#endif // _BENCH_H_
@@ -0,0 +1,104 @@
+/*
+ * Runs the benchmark firmware on simavr and prints the cycles of every case,
+ * less the cost of the markers, and the flash the image takes, as one tab
+ * separated row per measurement:
+ *
+ *   commit  case  value  unit
+ *
+ * The commit column is the second argument, so the rows of several commits
+ * can be concatenated and compared.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_io.h>
+
+#include "bench.h"
+
+#define SIM_MCU "atmega32u4"
+#define SIM_FREQUENCY 16000000UL
+#define SIM_NOT_RUN UINT64_MAX
+
+#define BENCH_NAME(id, name) name,
+static const char *const names[] = {BENCH_CASES(BENCH_NAME)};
+#undef BENCH_NAME
+
+static avr_cycle_count_t started;
+static uint8_t running = BENCH_COUNT;
+static uint64_t cycles[BENCH_COUNT];
+
+static void on_start(avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param) {
+  (void)addr;
+  (void)param;
+  running = v;
+  started = avr->cycle;
+}
+
+static void on_stop(avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param) {
+  (void)addr;
+  (void)v;
+  (void)param;
+  if (running < BENCH_COUNT) {
+    cycles[running] = avr->cycle - started;
+  }
+  running = BENCH_COUNT;
+}
+
+int main(int argc, char *argv[]) {
+  elf_firmware_t firmware = {0};
+  const char *commit;
+  avr_t *avr;
+  int state;
+
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <bench.elf> [commit]\n", argv[0]);
+    return 1;
+  }
+  commit = (argc >= 3) ? argv[2] : "-";
+
+  if (elf_read_firmware(argv[1], &firmware) != 0) {
+    fprintf(stderr, "%s: can't read firmware\n", argv[1]);
+    return 1;
+  }
+
+  avr = avr_make_mcu_by_name(SIM_MCU);
+  if (avr == NULL) {
+    fprintf(stderr, "simavr has no %s core\n", SIM_MCU);
+    return 1;
+  }
+  avr_init(avr);
+  avr_load_firmware(avr, &firmware);
+  avr->frequency = SIM_FREQUENCY;
+  avr->log = LOG_NONE;
+
+  for (int i = 0; i < BENCH_COUNT; i++) {
+    cycles[i] = SIM_NOT_RUN;
+  }
+  avr_register_io_write(avr, BENCH_START_IO, on_start, NULL);
+  avr_register_io_write(avr, BENCH_STOP_IO, on_stop, NULL);
+
+  do {
+    state = avr_run(avr);
+  } while (state != cpu_Done && state != cpu_Crashed);
+
+  if (state == cpu_Crashed || cycles[BENCH_EMPTY] == SIM_NOT_RUN) {
+    fprintf(stderr, "%s: firmware crashed\n", argv[1]);
+    return 1;
+  }
+
+  printf("commit\tcase\tvalue\tunit\n");
+  for (int i = BENCH_EMPTY + 1; i < BENCH_COUNT; i++) {
+    if (cycles[i] == SIM_NOT_RUN) {
+      printf("%s\t%s\t-\tcycles\n", commit, names[i]);
+    } else {
+      printf("%s\t%s\t%llu\tcycles\n", commit, names[i],
+             (unsigned long long)(cycles[i] - cycles[BENCH_EMPTY]));
+    }
+  }
+  printf("%s\tflash\t%lu\tbytes\n", commit,
+         (unsigned long)firmware.flashsize);
+  return 0;
+}
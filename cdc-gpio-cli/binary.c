@@ -0,0 +1,224 @@
+#include <stddef.h>
+#include <util/crc16.h>
+
+#include "binary.h"
+#include "gpio.h"
+#include "usb.h"
+
+#define BINARY_CRC_INIT 0xFFFF
+
+// the largest COBS block, a code byte of 0xFF followed by 254 data bytes
+#define COBS_BLOCK_SIZE 254
+
+static uint8_t frame[BINARY_FRAME_SIZE];
+static uint8_t frame_length;
+static uint8_t frame_overrun;
+static uint8_t reply[BINARY_FRAME_SIZE];
+
+static uint16_t crc16(const uint8_t *data, uint8_t length) {
+  uint16_t crc = BINARY_CRC_INIT;
+
+  for (uint8_t i = 0; i < length; i++) {
+    crc = _crc_xmodem_update(crc, data[i]);
+  }
+  return crc;
+}
+
+// Decodes a COBS frame in place and returns the decoded length, or 0 if the
+// frame is malformed.
+static uint8_t cobs_decode(uint8_t *data, uint8_t length) {
+  uint8_t read = 0;
+  uint8_t write = 0;
+
+  while (read < length) {
+    uint8_t code = data[read++];
+
+    if (code == 0 || (uint16_t)read + code - 1 > length) {
+      return 0;
+    }
+
+    for (uint8_t i = 1; i < code; i++) {
+      data[write++] = data[read++];
+    }
+
+    if (code != COBS_BLOCK_SIZE + 1 && read < length) {
+      data[write++] = 0;
+    }
+  }
+  return write;
+}
+
+static void cobs_send(const uint8_t *data, uint8_t length) {
+  uint8_t start = 0;
+  uint8_t delimiter = 0;
+
+  for (;;) {
+    uint8_t end = start;
+    uint8_t code;
+
+    while (end < length && data[end] != 0 && end - start < COBS_BLOCK_SIZE) {
+      end++;
+    }
+
+    code = end - start + 1;
+    usb_send(&code, 1);
+    usb_send(&data[start], end - start);
+
+    if (end == length) {
+      break;
+    }
+    start = (data[end] == 0) ? end + 1 : end;
+  }
+
+  usb_send(&delimiter, 1);
+}
+
+static void send_reply(uint8_t length) {
+  uint16_t crc = crc16(reply, length);
+
+  reply[length++] = crc & 0xFF;
+  reply[length++] = crc >> 8;
+  cobs_send(reply, length);
+}
+
+// Returns the number of argument bytes an operation takes, or -1 if the
+// operation is unknown.
+static int8_t op_argc(uint8_t op) {
+  switch (op) {
+  case BINARY_OP_REG_READ:
+  case BINARY_OP_PIN_READ:
+    return 1;
+  case BINARY_OP_REG_WRITE:
+  case BINARY_OP_PIN_WRITE:
+  case BINARY_OP_PIN_MODE:
+  case BINARY_OP_REG_TOGGLE:
+    return 2;
+  case BINARY_OP_REG_MASK:
+    return 3;
+  case BINARY_OP_EXIT:
+    return 0;
+  default:
+    return -1;
+  }
+}
+
+// Runs every operation of a decoded request and returns 0 if the request asked
+// to leave binary mode.
+static uint8_t process_frame(uint8_t length) {
+  uint8_t offset = 1;
+  uint8_t result = 2;
+  uint8_t status = BINARY_STATUS_OK;
+  uint8_t stay = 1;
+
+  if (length < 3 || crc16(frame, length - 2) !=
+                        (frame[length - 2] | (frame[length - 1] << 8))) {
+    reply[0] = (length > 0) ? frame[0] : 0;
+    reply[1] = BINARY_STATUS_BAD_FRAME;
+    send_reply(2);
+    return 1;
+  }
+
+  length -= 2;
+
+  while (offset < length && status == BINARY_STATUS_OK) {
+    uint8_t op = frame[offset];
+    int8_t argc = op_argc(op);
+    const uint8_t *argv = &frame[offset + 1];
+    int16_t value = GPIO_ERROR_NONE;
+
+    if (argc < 0) {
+      status = BINARY_STATUS_BAD_OP;
+      break;
+    }
+
+    if (offset + 1 + argc > length) {
+      status = BINARY_STATUS_BAD_FRAME;
+      break;
+    }
+
+    switch (op) {
+    case BINARY_OP_REG_READ:
+      value = gpio_read(argv[0]);
+      break;
+    case BINARY_OP_REG_WRITE:
+      value = gpio_write(argv[0], argv[1]);
+      break;
+    case BINARY_OP_PIN_READ:
+      value = gpio_get_level(argv[0]);
+      break;
+    case BINARY_OP_PIN_WRITE:
+      value = gpio_set_level(argv[0], argv[1]);
+      break;
+    case BINARY_OP_PIN_MODE:
+      value = gpio_set_direction(argv[0], argv[1]);
+      break;
+    case BINARY_OP_REG_MASK:
+      value = gpio_write_mask(argv[0], argv[1], argv[2]);
+      break;
+    case BINARY_OP_REG_TOGGLE:
+      value = gpio_toggle_mask(argv[0], argv[1]);
+      break;
+    case BINARY_OP_EXIT:
+      stay = 0;
+      break;
+    }
+
+    if (value < 0) {
+      status = BINARY_STATUS_BAD_ARG;
+    } else if (op == BINARY_OP_REG_READ || op == BINARY_OP_PIN_READ) {
+      if (result >= sizeof(reply) - 2) {
+        status = BINARY_STATUS_OVERFLOW;
+      } else {
+        reply[result++] = value;
+      }
+    }
+
+    if (status == BINARY_STATUS_OK) {
+      offset += 1 + argc;
+    }
+  }
+
+  reply[0] = frame[0];
+  reply[1] = status;
+
+  if (status != BINARY_STATUS_OK) {
+    reply[2] = offset;
+    result = 3;
+    stay = 1;
+  }
+
+  send_reply(result);
+  return stay;
+}
+
+void binary_init(void) {
+  frame_length = 0;
+  frame_overrun = 0;
+}
+
+/** Feeds one received byte to the binary protocol and returns 0 once the host
+ * has left binary mode, so the following bytes go back to the text CLI.
+ */
+uint8_t binary_putc(uint8_t byte) {
+  uint8_t length;
+
+  if (byte != BINARY_ESCAPE) {
+    if (frame_length < sizeof(frame)) {
+      frame[frame_length++] = byte;
+    } else {
+      frame_overrun = 1;
+    }
+    return 1;
+  }
+
+  // an empty frame only resynchronises the stream
+  if (frame_length == 0) {
+    return 1;
+  }
+
+  length = frame_overrun ? 0 : cobs_decode(frame, frame_length);
+  frame_length = 0;
+  frame_overrun = 0;
+
+  return process_frame(length);
+}
@@ -0,0 +1,49 @@
+#ifndef _BINARY_H_
+#define _BINARY_H_
+
+#include <stdint.h>
+
+/*
+ * Binary request/response protocol for automation, sharing the CDC port with
+ * the text CLI. A single BINARY_ESCAPE byte received by the CLI switches the
+ * port into binary mode, where every frame is COBS encoded and terminated by
+ * a 0x00 byte. A decoded request frame is
+ *
+ *   <seq> <op> [args...] [<op> [args...]]... <crc16 lo> <crc16 hi>
+ *
+ * and is answered by one frame
+ *
+ *   <seq> <status> [results...] <crc16 lo> <crc16 hi>
+ *
+ * where results holds one byte per read operation, in request order. If the
+ * status is not BINARY_STATUS_OK, results holds the offset of the failing
+ * operation in the request instead and no later operation is run. The CRC is
+ * CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF) over the
+ * preceding bytes. Registers and pins are given as their gpio_register_t and
+ * gpio_pin_t values.
+ */
+
+#define BINARY_ESCAPE 0x00
+#define BINARY_FRAME_SIZE 64
+
+typedef enum {
+  BINARY_OP_REG_READ = 0x01,   // <reg> -> <value>
+  BINARY_OP_REG_WRITE = 0x02,  // <reg> <value>
+  BINARY_OP_PIN_READ = 0x03,   // <pin> -> <level>
+  BINARY_OP_PIN_WRITE = 0x04,  // <pin> <level>
+  BINARY_OP_PIN_MODE = 0x05,   // <pin> <direction>
+  BINARY_OP_REG_MASK = 0x06,   // <reg> <mask> <value>, atomic masked write
+  BINARY_OP_REG_TOGGLE = 0x07, // <reg> <mask>
+  BINARY_OP_EXIT = 0x7F,       // leave binary mode once the reply is sent
+} binary_op_t;
+
+#define BINARY_STATUS_OK 0x00
+#define BINARY_STATUS_BAD_FRAME 0x01 // broken COBS, CRC or truncated op
+#define BINARY_STATUS_BAD_OP 0x02    // unknown operation code
+#define BINARY_STATUS_BAD_ARG 0x03   // rejected by the gpio module
+#define BINARY_STATUS_OVERFLOW 0x04  // too many results for one frame
+
+void binary_init(void);
+uint8_t binary_putc(uint8_t byte);
+
+#endif // _BINARY_H_
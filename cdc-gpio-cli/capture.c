@@ -0,0 +1,399 @@
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <stddef.h>
+#include <util/atomic.h>
+
+#include "capture.h"
+
+#define CAPTURE_HALF_SIZE (CAPTURE_BUFFER_SIZE / 2)
+
+#if (CAPTURE_BUFFER_SIZE % 12) != 0
+#error "CAPTURE_BUFFER_SIZE must be a multiple of 12"
+#endif
+
+typedef struct {
+  uint16_t index;           // where the next sample goes
+  uint16_t end;             // where the current buffer or half ends
+  uint32_t remaining;       // samples left to take
+  uint8_t groups;
+  uint8_t mode;
+  volatile uint8_t state;
+  volatile uint8_t ready;   // completed halves not handed out yet, bit per half
+  volatile uint16_t length; // bytes in the last, partial half when done
+  uint8_t size;             // bytes per sample
+  uint8_t pending;          // the trigger has not fired yet
+  uint8_t wrapped;          // the trigger ring went round, index is its oldest
+  uint16_t fill;            // samples to take before the trigger is compared
+  uint8_t mask[4];          // the trigger, per byte of a sample
+  uint8_t value[4];
+} capture_t;
+
+// The trigger as set, a byte per group like the SUMP channels.
+typedef struct {
+  uint32_t mask;
+  uint32_t value;
+  uint16_t pre;
+} capture_trigger_setup_t;
+
+static uint8_t buffer[CAPTURE_BUFFER_SIZE];
+static capture_t capture;
+static capture_trigger_setup_t trigger_setup;
+
+static const uint16_t prescalers[] = {1, 8, 64, 256, 1024};
+
+static void timer_stop(void) {
+  TIMSK1 = 0;
+  TCCR1B = 0;
+}
+
+// Counts down the samples before the trigger, then compares the sample at
+// start with it. Returns 1 while the trigger has not fired.
+static uint8_t trigger_pending(uint16_t start) {
+  if (capture.fill > 0) {
+    capture.fill--;
+    return 1;
+  }
+
+  for (uint8_t i = 0; i < capture.size; i++) {
+    if ((buffer[start + i] ^ capture.value[i]) & capture.mask[i]) {
+      return 1;
+    }
+  }
+
+  capture.pending = 0;
+  return 0;
+}
+
+// Samples the selected groups on every compare match of timer 1.
+ISR(TIMER1_COMPA_vect) {
+  uint16_t index = capture.index;
+  uint16_t start = index;
+  uint8_t groups = capture.groups;
+
+  if (groups & CAPTURE_GROUP_B) {
+    buffer[index++] = PINB;
+  }
+  if (groups & CAPTURE_GROUP_D) {
+    buffer[index++] = PIND;
+  }
+  if (groups & CAPTURE_GROUP_F) {
+    buffer[index++] = PINF;
+  }
+  if (groups & CAPTURE_GROUP_CE) {
+    buffer[index++] = (PINC & 0xC0) | ((PINE >> 2) & 0x11);
+  }
+
+  // the trigger mode buffer is a ring, capture_get_buffer() puts it in order
+  if (capture.mode == CAPTURE_MODE_TRIGGER && index == CAPTURE_BUFFER_SIZE) {
+    index = 0;
+    capture.wrapped = 1;
+  }
+
+  if (capture.pending && trigger_pending(start)) {
+    // the samples to take are counted from the trigger sample on
+  } else if (--capture.remaining == 0) {
+    timer_stop();
+    if (capture.mode == CAPTURE_MODE_STREAM) {
+      capture.length = index - (capture.end - CAPTURE_HALF_SIZE);
+    } else if (capture.wrapped) {
+      capture.length = CAPTURE_BUFFER_SIZE;
+    } else {
+      capture.length = index;
+    }
+    capture.state = CAPTURE_DONE;
+  } else if (index >= capture.end) {
+    if (capture.mode == CAPTURE_MODE_BUFFER) {
+      timer_stop();
+      capture.length = index;
+      capture.state = CAPTURE_DONE;
+    } else {
+      uint8_t half = (index == CAPTURE_HALF_SIZE) ? 0x01 : 0x02;
+      uint8_t other = half ^ 0x03;
+
+      if (capture.ready & other) {
+        timer_stop();
+        capture.state = CAPTURE_OVERRUN;
+      }
+      capture.ready |= half;
+      capture.end = (half == 0x01) ? CAPTURE_BUFFER_SIZE : CAPTURE_HALF_SIZE;
+      if (index == CAPTURE_BUFFER_SIZE) {
+        index = 0;
+      }
+    }
+  }
+
+  capture.index = index;
+}
+
+uint8_t capture_sample_size(uint8_t groups) {
+  return ((groups >> 0) & 1) + ((groups >> 1) & 1) + ((groups >> 2) & 1) +
+         ((groups >> 3) & 1);
+}
+
+uint32_t capture_max_rate(void) { return F_CPU / CAPTURE_MIN_PERIOD; }
+
+/** Sets the trigger of the next CAPTURE_MODE_TRIGGER capture: the first
+ * sample whose bits in \p mask equal those in \p value, after at least \p pre
+ * samples, so that many are always there before it. Bit 8 * n of both is bit
+ * 0 of group n, the bits of groups that are not sampled are ignored.
+ */
+void capture_set_trigger(uint32_t mask, uint32_t value, uint16_t pre) {
+  trigger_setup.mask = mask;
+  trigger_setup.value = value;
+  trigger_setup.pre = pre;
+}
+
+// Lays the trigger out like the bytes of a sample of the given groups.
+static void trigger_init(uint8_t groups) {
+  uint8_t size = 0;
+
+  for (uint8_t group = 0; group < 4; group++) {
+    if (groups & (1 << group)) {
+      capture.mask[size] = trigger_setup.mask >> (group * 8);
+      capture.value[size] = trigger_setup.value >> (group * 8);
+      size++;
+    }
+  }
+  capture.fill = trigger_setup.pre;
+  capture.pending = 1;
+}
+
+/** Starts sampling the given groups at the closest rate timer 1 can produce
+ * and returns that rate, or 0 if the arguments are invalid. In buffer mode at
+ * most one buffer of samples is taken. In trigger mode \p samples are taken
+ * from the trigger sample on, and the buffer keeps the last buffer full.
+ */
+uint32_t capture_start(uint8_t groups, uint32_t rate, uint32_t samples,
+                       capture_mode_t mode) {
+  uint32_t period;
+  uint32_t min_period = (mode == CAPTURE_MODE_TRIGGER)
+                            ? CAPTURE_TRIGGER_MIN_PERIOD
+                            : CAPTURE_MIN_PERIOD;
+  uint32_t top = 0;
+  uint8_t clock;
+
+  groups &= CAPTURE_GROUP_ALL;
+  if (groups == 0 || rate == 0 || samples == 0) {
+    return 0;
+  }
+
+  capture_stop();
+
+  period = F_CPU / rate;
+  if (period < min_period) {
+    period = min_period;
+  }
+
+  for (clock = 0; clock < sizeof(prescalers) / sizeof(prescalers[0]);
+       clock++) {
+    top = period / prescalers[clock];
+    if (top <= 0x10000) {
+      break;
+    }
+  }
+
+  if (clock == sizeof(prescalers) / sizeof(prescalers[0])) {
+    return 0;
+  }
+
+  capture.index = 0;
+  capture.groups = groups;
+  capture.mode = mode;
+  capture.ready = 0;
+  capture.length = 0;
+  capture.remaining = samples;
+  capture.end = (mode == CAPTURE_MODE_STREAM) ? CAPTURE_HALF_SIZE
+                                              : CAPTURE_BUFFER_SIZE;
+  capture.size = capture_sample_size(groups);
+  capture.pending = 0;
+  capture.wrapped = 0;
+  if (mode == CAPTURE_MODE_TRIGGER) {
+    trigger_init(groups);
+  }
+  capture.state = CAPTURE_RUNNING;
+
+  TCCR1A = 0;
+  TCNT1 = 0;
+  OCR1A = top - 1;
+  TIFR1 = _BV(OCF1A);
+  TIMSK1 = _BV(OCIE1A);
+  TCCR1B = _BV(WGM12) | (clock + 1);
+
+  return F_CPU / (prescalers[clock] * top);
+}
+
+void capture_stop(void) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    timer_stop();
+    if (capture.state == CAPTURE_RUNNING) {
+      capture.state = CAPTURE_IDLE;
+    }
+  }
+}
+
+capture_state_t capture_get_state(void) { return capture.state; }
+
+/** Hands every completed half of a streaming capture to the sink and releases
+ * it to the sampling interrupt again. Returns 0 once the capture has ended and
+ * all of its samples were handed out.
+ */
+uint8_t capture_task(capture_sink_t sink) {
+  // read the state first, so a half completed after it is still seen below
+  uint8_t state = capture.state;
+  uint8_t ready = capture.ready;
+
+  if (ready & 0x01) {
+    sink(&buffer[0], CAPTURE_HALF_SIZE);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { capture.ready &= ~0x01; }
+  }
+  if (ready & 0x02) {
+    sink(&buffer[CAPTURE_HALF_SIZE], CAPTURE_HALF_SIZE);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { capture.ready &= ~0x02; }
+  }
+
+  if (state == CAPTURE_RUNNING) {
+    return 1;
+  }
+
+  if (state == CAPTURE_DONE && capture.mode == CAPTURE_MODE_STREAM &&
+      capture.length > 0) {
+    sink(&buffer[capture.end - CAPTURE_HALF_SIZE], capture.length);
+    capture.length = 0;
+  }
+  return 0;
+}
+
+static void reverse(uint8_t *data, uint16_t length) {
+  uint8_t *end = data + length;
+
+  while (data + 1 < end) {
+    uint8_t byte = *data;
+    *data++ = *--end;
+    *end = byte;
+  }
+}
+
+// Rotates the buffer used as a ring so the sample at index comes first.
+static void rotate(uint16_t index) {
+  reverse(buffer, index);
+  reverse(&buffer[index], CAPTURE_BUFFER_SIZE - index);
+  reverse(buffer, CAPTURE_BUFFER_SIZE);
+}
+
+/** Returns the samples of a finished buffer or trigger mode capture, oldest
+ * first.
+ */
+const uint8_t *capture_get_buffer(uint16_t *length) {
+  if (capture.state == CAPTURE_DONE && capture.wrapped) {
+    rotate(capture.index);
+    capture.index = 0;
+    capture.wrapped = 0;
+  }
+  *length = (capture.state == CAPTURE_DONE) ? capture.length : 0;
+  return buffer;
+}
+
+/** Samples one register as fast as a tight loop can into the whole buffer
+ * used as a ring, until the trigger fires, then takes post more samples and
+ * stops. Interrupts, and with them USB, are off while it waits, for at most
+ * timeout_ms, which may be up to CAPTURE_TRIGGER_MAX_MS. Timer 1 runs at the CPU clock to time out the wait and to
+ * measure both loops. Afterwards capture_get_buffer() returns the samples
+ * oldest first, the trigger sample is at result->pre_samples.
+ */
+int16_t capture_triggered(gpio_register_t reg, capture_trigger_t trigger,
+                          uint8_t mask, uint8_t value, uint16_t post,
+                          uint16_t timeout_ms, capture_result_t *result) {
+  volatile uint8_t *port = gpio_get_address(reg);
+  uint16_t ticks = timeout_ms / CAPTURE_TIMEOUT_TICK_MS + 1;
+  uint16_t index = 0;
+  uint16_t spins = 0;
+  uint16_t pre_cycles = 0;
+  uint16_t post_cycles = 0;
+  uint16_t total;
+  uint8_t wrapped = 0;
+  uint8_t timed_out = 0;
+  uint8_t previous;
+
+  if (port == NULL || post >= CAPTURE_BUFFER_SIZE ||
+      timeout_ms > CAPTURE_TRIGGER_MAX_MS) {
+    return CAPTURE_ERROR_INVALID;
+  }
+
+  capture_stop();
+  capture.state = CAPTURE_IDLE;
+  capture.length = 0;
+  capture.wrapped = 0;
+  value &= mask;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TCNT1 = 0;
+    TIFR1 = _BV(TOV1);
+    TCCR1B = _BV(CS10);
+
+    previous = *port & mask;
+    for (;;) {
+      uint8_t sample = *port;
+
+      // the loop is timed over the iterations since the last overflow,
+      // including the one that fires the trigger
+      spins++;
+      buffer[index] = sample;
+      if (++index == CAPTURE_BUFFER_SIZE) {
+        index = 0;
+        wrapped = 1;
+      }
+
+      sample &= mask;
+      if (sample == value &&
+          (previous != value || trigger == CAPTURE_TRIGGER_MATCH)) {
+        break;
+      }
+      previous = sample;
+
+      if (TIFR1 & _BV(TOV1)) {
+        TIFR1 = _BV(TOV1);
+        spins = 0;
+        if (--ticks == 0) {
+          timed_out = 1;
+          break;
+        }
+      }
+    }
+    pre_cycles = TCNT1;
+
+    if (!timed_out) {
+      TCNT1 = 0;
+      for (uint16_t i = post; i > 0; i--) {
+        buffer[index] = *port;
+        if (++index == CAPTURE_BUFFER_SIZE) {
+          index = 0;
+          wrapped = 1;
+        }
+      }
+      post_cycles = TCNT1;
+    }
+
+    TCCR1B = 0;
+  }
+
+  if (timed_out) {
+    return CAPTURE_ERROR_TIMEOUT;
+  }
+
+  // rotate the ring so the oldest sample comes first
+  total = wrapped ? CAPTURE_BUFFER_SIZE : index;
+  if (wrapped) {
+    rotate(index);
+  }
+
+  capture.length = total;
+  capture.state = CAPTURE_DONE;
+
+  result->pre_samples = total - post - 1;
+  result->post_samples = post;
+  result->pre_interval = spins ? (uint32_t)pre_cycles * 10 / spins : 0;
+  result->post_interval = post ? (uint32_t)post_cycles * 10 / post : 0;
+  return CAPTURE_ERROR_NONE;
+}
@@ -0,0 +1,80 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stdint.h>
+
+#include "gpio.h"
+
+// Channel groups, each one is a byte of every sample, in this order.
+#define CAPTURE_GROUP_B 0x01  // PINB
+#define CAPTURE_GROUP_D 0x02  // PIND
+#define CAPTURE_GROUP_F 0x04  // PINF
+#define CAPTURE_GROUP_CE 0x08 // PC6 PC7 as bits 6 7, PE2 PE6 as bits 0 4
+#define CAPTURE_GROUP_ALL 0x0F
+
+// Sample memory, divisible by every sample size from 1 to 4 bytes, and split
+// into two halves while streaming.
+#ifndef CAPTURE_BUFFER_SIZE
+#define CAPTURE_BUFFER_SIZE 768
+#endif
+
+#define CAPTURE_ERROR_NONE 0
+#define CAPTURE_ERROR_INVALID -1
+#define CAPTURE_ERROR_TIMEOUT -2
+
+// The shortest sampling period in CPU cycles the timer interrupt can keep up
+// with when all four groups are sampled.
+#define CAPTURE_MIN_PERIOD 128
+// The same while a trigger is compared against every sample, which takes up
+// to about 40 cycles more with all four groups.
+#define CAPTURE_TRIGGER_MIN_PERIOD 192
+
+typedef enum {
+  CAPTURE_IDLE,
+  CAPTURE_RUNNING,
+  CAPTURE_DONE,
+  CAPTURE_OVERRUN, // streaming stopped, the host didn't take a half in time
+} capture_state_t;
+
+typedef enum {
+  CAPTURE_MODE_BUFFER,  // fill the buffer once, then stop
+  CAPTURE_MODE_STREAM,  // hand out each completed half while the other fills
+  CAPTURE_MODE_TRIGGER, // fill the buffer as a ring until a sample matches
+                        // capture_set_trigger(), then take the samples after
+                        // it and stop
+} capture_mode_t;
+
+typedef enum {
+  CAPTURE_TRIGGER_MATCH, // the masked port equals the value
+  CAPTURE_TRIGGER_EDGE,  // the masked port changes to the value
+} capture_trigger_t;
+
+// Milliseconds per overflow of the trigger timeout, 65536 cycles.
+#define CAPTURE_TIMEOUT_TICK_MS 4
+// The longest trigger wait. USB is off meanwhile, control requests and the
+// host's packets go unanswered for as long.
+#define CAPTURE_TRIGGER_MAX_MS 1000
+
+typedef struct {
+  uint16_t pre_samples;  // samples before the trigger sample
+  uint16_t post_samples; // samples after it
+  uint32_t pre_interval;  // cycles between samples before the trigger, x10
+  uint32_t post_interval; // cycles between samples after the trigger, x10
+} capture_result_t;
+
+typedef void (*capture_sink_t)(const uint8_t *data, uint16_t length);
+
+void capture_set_trigger(uint32_t mask, uint32_t value, uint16_t pre);
+uint32_t capture_start(uint8_t groups, uint32_t rate, uint32_t samples,
+                       capture_mode_t mode);
+void capture_stop(void);
+capture_state_t capture_get_state(void);
+uint8_t capture_task(capture_sink_t sink);
+const uint8_t *capture_get_buffer(uint16_t *length);
+uint8_t capture_sample_size(uint8_t groups);
+uint32_t capture_max_rate(void);
+int16_t capture_triggered(gpio_register_t reg, capture_trigger_t trigger,
+                          uint8_t mask, uint8_t value, uint16_t post,
+                          uint16_t timeout_ms, capture_result_t *result);
+
+#endif // _CAPTURE_H_
@@ -1,25 +1,46 @@
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include <avr/wdt.h>
-#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <util/atomic.h>
 
+#include "capture.h"
 #include "command.h"
+#include "events.h"
 #include "gpio.h"
+#include "idle.h"
+#include "names.h"
+#include "names_table.h"
+#include "out.h"
+#include "pattern.h"
+#include "sump.h"
+#include "timebase.h"
 #include "usb.h"
 #include "version.h"
 
 #define LINE_BUFFER_SIZE 128
 #define ARGUMENT_BUFFER_SIZE 32
 
-typedef struct {
-  const char *str;
-  gpio_register_t reg;
-} str2reg_t;
+// Ends a command within a line, see command_putc().
+#define COMMAND_SEPARATOR ';'
+
+// The longest write of the CLI held back as the prompt, see end_command().
+#define PROMPT_BUFFER_SIZE 8
+
+typedef enum {
+  BATCH_READ_PIN,
+  BATCH_READ_REG,
+  BATCH_WRITE_PIN,
+  BATCH_MODE_PIN,
+  BATCH_WRITE_REG,
+} batch_type_t;
 
 typedef struct {
-  const char *str;
-  gpio_pin_t pin;
-} str2pin_t;
+  uint8_t type;
+  uint8_t id;
+  uint8_t value;
+} batch_op_t;
 
 // declare the command functions
 static void process_help(mcucli_t *cli, void *user_data, int argc,
@@ -28,76 +49,179 @@ static void process_gpio(mcucli_t *cli, void *user_data, int argc,
                          char *argv[]);
 static void process_version(mcucli_t *cli, void *user_data, int argc,
                          char *argv[]);
+static void process_time(mcucli_t *cli, void *user_data, int argc,
+                         char *argv[]);
+static void process_idle(mcucli_t *cli, void *user_data, int argc,
+                         char *argv[]);
 static void process_reboot(mcucli_t *cli, void *user_data, int argc,
                          char *argv[]);
 static void process_bootloader(mcucli_t *cli, void *user_data, int argc,
                          char *argv[]);
+static void process_usb(mcucli_t *cli, void *user_data, int argc,
+                        char *argv[]);
+static void process_batch(mcucli_t *cli, void *user_data, int argc,
+                          char *argv[]);
+static void process_capture(mcucli_t *cli, void *user_data, int argc,
+                            char *argv[]);
+static void process_pattern(mcucli_t *cli, void *user_data, int argc,
+                            char *argv[]);
+static void process_event(mcucli_t *cli, void *user_data, int argc,
+                          char *argv[]);
 
-static mcucli_command_t commands[] = {
-    {"help", "Print this help message", process_help},
-    {"?", "Print this help message", process_help},
-    {"gpio",
-     "Utility to control GPIO pins.\r\n"
-     "  - Usage of control the GPIO register:\r\n"
-     "      gpio help, print this help message\r\n"
-     "      gpio ?, print this help message\r\n"
-     "      gpio all, print all the registers\r\n"
-     "      gpio <register>, print the register value\r\n"
-     "      gpio <register> <value>, set the register value\r\n"
-     "      gpio <pin>, print the pin value\r\n"
-     "      gpio <pin> <mode>, set the pin mode, in for input, out for "
-     "output\r\n"
-     "      gpio <pin> <value>, set the pin value, 0 for low, 1 for high\r\n"
-     "  - Available registers:\r\n"
-     "      MCUCR, MCU Control Register\r\n"
-     "      DDRB DDRC DDRD DDRE DDRF, Data Direction Registers\r\n"
-     "      PORTB PORTC PORTD PORTE PORTF, Port Data Registers\r\n"
-     "      PINB PINC PIND PINE PINF, Port Input Pins\r\n"
-     "  - Available pins:\r\n"
-     "      PB0 PB1 PB2 PB3 PB4 PB5 PB6 PB7, Port B\r\n"
-     "      PC6 PC7, Port C\r\n"
-     "      PD0 PD1 PD2 PD3 PD4 PD5 PD6 PD7, Port D\r\n"
-     "      PE2 PE6, Port E\r\n"
-     "      PF0 PF1 PF4 PF5 PF6 PF7, Port F\r\n"
-     "",
-     process_gpio},
-    {"version", "Print the firmware version", process_version},
-    {"reboot", "Reboot the MCU", process_reboot},
-    {"bootloader", "Enter the bootloader", process_bootloader},
-};
+// The help texts are only ever printed by this file, so they stay in flash and
+// the command table only holds their addresses.
+static const char help_help[] PROGMEM =
+    "Print this help message.\r\n"
+    "  - Command lists:\r\n"
+    "      <command>;<command>;..., run the commands in order, the output of\r\n"
+    "          each one is followed by a line ;<n>, n counting from 0 on\r\n"
+    "          every line. End a single command with ; to get the line too\r\n"
+    "";
+static const char help_gpio[] PROGMEM =
+    "Utility to control GPIO pins.\r\n"
+    "  - Usage of control the GPIO register:\r\n"
+    "      gpio help, print this help message\r\n"
+    "      gpio ?, print this help message\r\n"
+    "      gpio all, print all the registers\r\n"
+    "      gpio <register>, print the register value\r\n"
+    "      gpio <register> <value>, set the register value\r\n"
+    "      gpio <pin>, print the pin value\r\n"
+    "      gpio <pin> <mode>, set the pin mode, in for input, out for "
+    "output\r\n"
+    "      gpio <pin> <value>, set the pin value, 0 for low, 1 for high\r\n"
+    "      gpio <pin> toggle, toggle the pin value\r\n"
+    "      gpio <pin>,<pin>,... <mode|value|toggle>, change several pins of\r\n"
+    "          one port in a single atomic update\r\n"
+    "      gpio <register> set|clear|toggle <mask>, atomically set, clear or\r\n"
+    "          toggle the bits in mask\r\n"
+    "  - Available registers:\r\n"
+    "      MCUCR, MCU Control Register\r\n"
+    "      DDRB DDRC DDRD DDRE DDRF, Data Direction Registers\r\n"
+    "      PORTB PORTC PORTD PORTE PORTF, Port Data Registers\r\n"
+    "      PINB PINC PIND PINE PINF, Port Input Pins\r\n"
+    "  - Available pins:\r\n"
+    "      PB0 PB1 PB2 PB3 PB4 PB5 PB6 PB7, Port B\r\n"
+    "      PC6 PC7, Port C\r\n"
+    "      PD0 PD1 PD2 PD3 PD4 PD5 PD6 PD7, Port D\r\n"
+    "      PE2 PE6, Port E\r\n"
+    "      PF0 PF1 PF4 PF5 PF6 PF7, Port F\r\n"
+    "";
+static const char help_version[] PROGMEM = "Print the firmware version";
+static const char help_time[] PROGMEM =
+    "Print the microsecond timebase and the cycles one read of it takes";
+static const char help_idle[] PROGMEM =
+    "Show how much the main loop sleeps.\r\n"
+    "  - Usage:\r\n"
+    "      idle stats, print the time spent in idle sleep, the power-down\r\n"
+    "          sleeps during USB suspend and the wake-up latency\r\n"
+    "      idle reset, clear the statistics\r\n"
+    "";
+static const char help_reboot[] PROGMEM = "Reboot the MCU";
+static const char help_bootloader[] PROGMEM = "Enter the bootloader";
+static const char help_usb[] PROGMEM =
+    "Utility to inspect the USB CDC transport.\r\n"
+    "  - Usage:\r\n"
+    "      usb stats, print the transfer and ring buffer overflow counters,\r\n"
+    "          and the IN packets per command reply\r\n"
+    "      usb bench <bytes>, send <bytes> bytes through the bulk write path,\r\n"
+    "          the per-byte write path and LUFA's CDC_Device_SendByte(),\r\n"
+    "          then print the three throughputs\r\n"
+    "";
+static const char help_batch[] PROGMEM =
+    "Run several GPIO operations back to back and print all reads at once.\r\n"
+    "  - Usage:\r\n"
+    "      batch [-a] <op> [<op> ...], -a runs the operations with interrupts\r\n"
+    "          disabled, so nothing can delay them in between\r\n"
+    "  - Available operations:\r\n"
+    "      <pin>, read the pin level\r\n"
+    "      <pin>=<value>, set the pin level, 0 for low, 1 for high\r\n"
+    "      <pin>=<mode>, set the pin mode, in for input, out for output\r\n"
+    "      <register>, read the register value\r\n"
+    "      <register>=<value>, set the register value\r\n"
+    "  - Example:\r\n"
+    "      batch -a PB5=out PB5=1 PB5=0 PINB\r\n"
+    "";
+
+static const char help_capture[] PROGMEM =
+    "Sample GPIO ports from a timer interrupt.\r\n"
+    "  - Usage:\r\n"
+    "      capture info, print the sample buffer size and the highest rates\r\n"
+    "      capture stream <ports> <rate> <samples>, sample <ports> at <rate>\r\n"
+    "          Hz and stream them run length encoded, each record is a run\r\n"
+    "          length of 1 to 255 followed by one sample, a run length of 0\r\n"
+    "          ends the stream\r\n"
+    "      capture trigger <pin> rise|fall <post> [ms], sample the port of\r\n"
+    "          <pin> as fast as possible until it rises or falls, keep <post>\r\n"
+    "          samples after that and print the buffer in hex, oldest first\r\n"
+    "      capture trigger <reg> <mask> <value> <post> [ms], the same with\r\n"
+    "          a trigger on (<reg> & <mask>) == <value>\r\n"
+    "          USB stops while waiting, for at most [ms], up to and by\r\n"
+    "          default 1000\r\n"
+    "      capture sump, switch the port to the SUMP/OLS protocol until the\r\n"
+    "          logic analyzer front end closes it\r\n"
+    "  - Available ports:\r\n"
+    "      any of B, D, F and C or E (PC6 PC7 PE2 PE6), e.g. BD, or all\r\n"
+    "";
+
+static const char help_pattern[] PROGMEM =
+    "Replay a sequence of port values with fixed timing.\r\n"
+    "  - Usage:\r\n"
+    "      pattern new <reg>[,<reg>...] [holds], start an empty pattern that\r\n"
+    "          writes up to 3 registers per step, with holds every step also\r\n"
+    "          has a number of timer periods it lasts, 0 for 256\r\n"
+    "      pattern add <step> [<step> ...], append steps, a step is\r\n"
+    "          <value>[,<value>...][:<hold>], one value per register\r\n"
+    "      pattern load <bytes>, take the next <bytes> bytes sent as raw\r\n"
+    "          steps, the values in register order followed by the hold\r\n"
+    "      pattern run <rate> [repeat], replay the steps at <rate> Hz from a\r\n"
+    "          timer interrupt, repeat times or until stopped if 0 or omitted\r\n"
+    "      pattern fast [repeat], replay a one register pattern without holds\r\n"
+    "          one step every 12 cycles, USB stops until it is done\r\n"
+    "      pattern stop, stop replaying\r\n"
+    "      pattern info, print the pattern size and state\r\n"
+    "  - Example:\r\n"
+    "      gpio PB0,PB1 out\r\n"
+    "      pattern new PORTB\r\n"
+    "      pattern add 0x01 0x03 0x02 0x00\r\n"
+    "      pattern run 10000\r\n"
+    "";
+
+static const char help_event[] PROGMEM =
+    "Report pin edges as they happen, with microsecond timestamps.\r\n"
+    "  - Usage:\r\n"
+    "      event arm <pin>[,<pin>...], report every edge of the pins\r\n"
+    "      event disarm [<pin>[,<pin>...]], stop reporting the pins, or all\r\n"
+    "      event stats, print the event rate, drops and worst latency\r\n"
+    "      event reset, clear the statistics\r\n"
+    "      event latency <pin> [count], toggle an armed output pin count\r\n"
+    "          times, 100 by default, and print the worst delay from an\r\n"
+    "          edge to its timestamp\r\n"
+    "  - Available pins:\r\n"
+    "      PB0 to PB7, PD0 to PD3 and PE6\r\n"
+    "  - Output:\r\n"
+    "      event <pin> <level> <time in us>, one line per edge\r\n"
+    "";
+
+// generated from names.spec
+static mcucli_command_t commands[] = {NAMES_COMMANDS};
 
 static mcucli_command_set_t command_set = {
   .commands = commands,
   .num_commands = sizeof(commands) / sizeof(mcucli_command_t),
 };
 
+static uint8_t list_index;   // commands of the current line run so far
+static uint8_t list_pending; // a command follows the last separator
+
+static bytes_write_t cli_write;
+static uint8_t prompt_holding; // end_command() is running a command
+static char prompt[PROMPT_BUFFER_SIZE];
+static uint8_t prompt_length;
+
 static char line_buffer[LINE_BUFFER_SIZE];
 static char *argument_buffer[ARGUMENT_BUFFER_SIZE];
 static mcucli_buffer_t buffer = {line_buffer, LINE_BUFFER_SIZE, argument_buffer, ARGUMENT_BUFFER_SIZE};
 
-static str2reg_t str2reg[] = {
-    {"MCUCR", GPIO_MCUCR}, {"DDRB", GPIO_DDRB},   {"DDRC", GPIO_DDRC},
-    {"DDRD", GPIO_DDRD},   {"DDRE", GPIO_DDRE},   {"DDRF", GPIO_DDRF},
-    {"PORTB", GPIO_PORTB}, {"PORTC", GPIO_PORTC}, {"PORTD", GPIO_PORTD},
-    {"PORTE", GPIO_PORTE}, {"PORTF", GPIO_PORTF}, {"PINB", GPIO_PINB},
-    {"PINC", GPIO_PINC},   {"PIND", GPIO_PIND},   {"PINE", GPIO_PINE},
-    {"PINF", GPIO_PINF},
-};
-
-static size_t num_str2reg = sizeof(str2reg) / sizeof(str2reg_t);
-
-static str2pin_t str2pin[] = {
-    {"PB0", GPIO_PB0}, {"PB1", GPIO_PB1}, {"PB2", GPIO_PB2}, {"PB3", GPIO_PB3},
-    {"PB4", GPIO_PB4}, {"PB5", GPIO_PB5}, {"PB6", GPIO_PB6}, {"PB7", GPIO_PB7},
-    {"PC6", GPIO_PC6}, {"PC7", GPIO_PC7}, {"PD0", GPIO_PD0}, {"PD1", GPIO_PD1},
-    {"PD2", GPIO_PD2}, {"PD3", GPIO_PD3}, {"PD4", GPIO_PD4}, {"PD5", GPIO_PD5},
-    {"PD6", GPIO_PD6}, {"PD7", GPIO_PD7}, {"PE2", GPIO_PE2}, {"PE6", GPIO_PE6},
-    {"PF0", GPIO_PF0}, {"PF1", GPIO_PF1}, {"PF4", GPIO_PF4}, {"PF5", GPIO_PF5},
-    {"PF6", GPIO_PF6}, {"PF7", GPIO_PF7},
-};
-
-static size_t num_str2pin = sizeof(str2pin) / sizeof(str2pin_t);
-
 static void to_uppercase(char *str) {
   for (size_t i = 0; str[i] != '\0'; i++) {
     if (str[i] >= 'a' && str[i] <= 'z') {
@@ -109,14 +233,17 @@ static void to_uppercase(char *str) {
 static void unknown_command(mcucli_t *cli, void *user_data, const char *command) {
   UNUSED(cli);
   UNUSED(user_data);
-  printf("Unknown command: %s\r\n", command);
+  out_fmt_P(PSTR("Unknown command: %s\r\n"), command);
 }
 
 static void process_help(mcucli_t *cli, void *user_data, int argc,
                          char *argv[]) {
   for (size_t i = 0; i < command_set.num_commands; i++) {
-    printf("- %s\r\n", command_set.commands[i].name);
-    printf("%s\r\n\r\n", command_set.commands[i].help);
+    out_P(PSTR("- "));
+    out_str(command_set.commands[i].name);
+    out_P(PSTR("\r\n"));
+    out_line_P(command_set.commands[i].help);
+    out_P(PSTR("\r\n"));
   }
 }
 
@@ -126,91 +253,131 @@ static uint8_t is_mode(const char *name) {
           name[3] == '\0');
 }
 
-static uint8_t is_pin(const char *name) {
-  uint8_t result = 1;
+static void print_pin_status(const name_entry_t *entry) {
+  int16_t direction = gpio_get_direction(entry->id);
+  int16_t level = gpio_get_level(entry->id);
 
-  result &= name[0] == 'P';
-  result &= name[1] == 'B' || name[1] == 'C' || name[1] == 'D' ||
-            name[1] == 'E' || name[1] == 'F';
-  result &= name[2] >= '0' && name[2] <= '7';
-  result &= name[3] == '\0';
-
-  return result;
+  if (direction < 0 || level < 0) {
+    out_fmt_P(PSTR("Failed to read pin %s\r\n"), entry->str);
+  } else {
+    out_fmt_P(PSTR("%s: %S, %S\r\n"), entry->str,
+              direction ? PSTR("OUT") : PSTR("IN"),
+              level ? PSTR("HIGH") : PSTR("LOW"));
+  }
 }
 
-static void print_pin_status(const char *name) {
-  for (size_t i = 0; i < num_str2pin; i++) {
-    if (strcmp(name, str2pin[i].str) == 0) {
-      int16_t direction = gpio_get_direction(str2pin[i].pin);
-      int16_t level = gpio_get_level(str2pin[i].pin);
-      if (direction < 0 || level < 0) {
-        printf("Failed to read pin %s\r\n", name);
-      } else {
-        printf("%s: %s, %s\r\n", name, direction ? "OUT" : "IN",
-               level ? "HIGH" : "LOW");
-      }
-      break;
+static void set_pin_mode(const name_entry_t *entry, const char *mode) {
+  if (mode[0] == 'I' && mode[1] == 'N' && mode[2] == '\0') {
+    if (gpio_set_direction(entry->id, 0) < 0) {
+      out_fmt_P(PSTR("Failed to set pin %s to input mode\r\n"), entry->str);
+    }
+  } else {
+    if (gpio_set_direction(entry->id, 1) < 0) {
+      out_fmt_P(PSTR("Failed to set pin %s to output mode\r\n"), entry->str);
     }
   }
 }
 
-static void set_pin_mode(const char *name, const char *mode) {
-  for (size_t i = 0; i < num_str2pin; i++) {
-    if (strcmp(name, str2pin[i].str) == 0) {
-      if (mode[0] == 'I' && mode[1] == 'N' && mode[2] == '\0') {
-        if (gpio_set_direction(str2pin[i].pin, 0) < 0) {
-          printf("Failed to set pin %s to input mode\r\n", name);
-        }
-      } else {
-        if (gpio_set_direction(str2pin[i].pin, 1) < 0) {
-          printf("Failed to set pin %s to output mode\r\n", name);
-        }
-      }
-      break;
-    }
+static void set_pin_value(const name_entry_t *entry, const char *value) {
+  if (gpio_set_level(entry->id, (uint8_t)strtol(value, NULL, 0)) < 0) {
+    out_fmt_P(PSTR("Failed to set pin %s to %s\r\n"), entry->str, value);
   }
 }
 
-static void set_pin_value(const char *name, const char *value) {
-  for (size_t i = 0; i < num_str2pin; i++) {
-    if (strcmp(name, str2pin[i].str) == 0) {
-      if (gpio_set_level(str2pin[i].pin, (uint8_t)strtol(value, NULL, 0)) < 0) {
-        printf("Failed to set pin %s to %s\r\n", name, value);
-      }
-      break;
+static void print_register_value(const name_entry_t *entry) {
+  int16_t value = gpio_read(entry->id);
+
+  if (value < 0) {
+    out_fmt_P(PSTR("Failed to read register %s\r\n"), entry->str);
+  } else {
+    out_str(entry->str);
+    out_P(PSTR(": 0x"));
+    out_hex8(value);
+    out_P(PSTR("\r\n"));
+  }
+}
+
+static void print_all_registers(void) {
+  name_entry_t entry;
+
+  for (uint8_t i = 0; i < name_count(); i++) {
+    name_get(i, &entry);
+    if (entry.kind == NAME_REGISTER) {
+      print_register_value(&entry);
     }
   }
 }
 
-static void print_register_value(const char *name) {
-  if (name[0] == 'A' && name[1] == 'L' && name[2] == 'L' && name[3] == '\0') {
-    for (size_t i = 0; i < num_str2reg; i++) {
-      print_register_value(str2reg[i].str);
+static void set_register_value(const name_entry_t *entry, uint8_t value) {
+  if (gpio_write(entry->id, value) < 0) {
+    out_fmt_P(PSTR("Failed to write 0x%02X to register %s\r\n"),
+              ((int)value) & 0xFF, entry->str);
+  }
+}
+
+// Changes every pin of a comma separated list with one masked update of their
+// port, the list and value are expected in upper case.
+static void set_pins(char *list, const char *value) {
+  name_entry_t entry;
+  int16_t port = -1;
+  uint8_t mask = 0;
+  int16_t result;
+
+  while (list != NULL) {
+    char *next = strchr(list, ',');
+
+    if (next != NULL) {
+      *next++ = '\0';
     }
-  } else {
-    for (size_t i = 0; i < num_str2reg; i++) {
-      if (strcmp(name, str2reg[i].str) == 0) {
-        int16_t value = gpio_read(str2reg[i].reg);
-        if (value < 0) {
-          printf("Failed to read register %s\r\n", name);
-        } else {
-          printf("%s: 0x%02X\r\n", name, ((int)value) & 0xFF);
-        }
-        break;
-      }
+
+    if (!name_lookup(list, &entry) || entry.kind != NAME_PIN) {
+      out_fmt_P(PSTR("Invalid pin: %s\r\n"), list);
+      return;
+    }
+
+    if (port >= 0 && gpio_get_port(entry.id) != port) {
+      out_P(PSTR("All pins must be on the same port\r\n"));
+      return;
     }
+
+    port = gpio_get_port(entry.id);
+    mask |= gpio_get_mask(entry.id);
+    list = next;
+  }
+
+  if (is_mode(value)) {
+    result = gpio_write_mask(GPIO_DDRB + port, mask,
+                             (value[0] == 'O') ? 0xFF : 0x00);
+  } else if (strcmp(value, "TOGGLE") == 0) {
+    result = gpio_toggle_mask(GPIO_PORTB + port, mask);
+  } else {
+    result = gpio_write_mask(GPIO_PORTB + port, mask,
+                             strtol(value, NULL, 0) ? 0xFF : 0x00);
+  }
+
+  if (result < 0) {
+    out_P(PSTR("Failed to update the pins\r\n"));
   }
 }
 
-static void set_register_value(const char *name, uint8_t value) {
-  for (size_t i = 0; i < num_str2reg; i++) {
-    if (strcmp(name, str2reg[i].str) == 0) {
-      if (gpio_write(str2reg[i].reg, value) < 0) {
-        printf("Failed to write 0x%02X to register %s\r\n", ((int)value) & 0xFF,
-               name);
-      }
-      break;
-    }
+static void update_register_mask(const name_entry_t *entry,
+                                 const char *operation, uint8_t mask) {
+  int16_t result;
+
+  if (strcmp(operation, "SET") == 0) {
+    result = gpio_set_mask(entry->id, mask);
+  } else if (strcmp(operation, "CLEAR") == 0) {
+    result = gpio_clear_mask(entry->id, mask);
+  } else if (strcmp(operation, "TOGGLE") == 0) {
+    result = gpio_toggle_mask(entry->id, mask);
+  } else {
+    out_fmt_P(PSTR("Invalid operation: %s\r\n"), operation);
+    return;
+  }
+
+  if (result < 0) {
+    out_fmt_P(PSTR("Failed to %s 0x%02X in register %s\r\n"), operation,
+              mask, entry->str);
   }
 }
 
@@ -218,40 +385,100 @@ static void process_gpio(mcucli_t *cli, void *user_data, int argc,
                          char *argv[]) {
   UNUSED(user_data);
 
+  name_entry_t entry;
+
   do {
     if (argc == 0 ||
         (argc == 1 && (strcmp(argv[0], "help") == 0 || argv[0][0] == '?'))) {
-      printf("%s\r\n", command_set.commands[2].help);
+      out_line_P(help_gpio);
       break;
     }
 
     to_uppercase(argv[0]);
 
-    if (argc == 1) {
-      if (is_pin(argv[0]))
-        print_pin_status(argv[0]);
+    if (argc == 1 && strcmp(argv[0], "ALL") == 0) {
+      print_all_registers();
+      break;
+    }
+
+    if (argc > 3) {
+      out_P(PSTR("Invalid number of arguments\r\n"));
+      break;
+    }
+
+    if (argc == 2 && strchr(argv[0], ',') != NULL) {
+      to_uppercase(argv[1]);
+      set_pins(argv[0], argv[1]);
+      break;
+    }
+
+    if (!name_lookup(argv[0], &entry)) {
+      break;
+    }
+
+    if (argc == 3) {
+      to_uppercase(argv[1]);
+      if (entry.kind == NAME_REGISTER) {
+        update_register_mask(&entry, argv[1],
+                             (uint8_t)strtol(argv[2], NULL, 0));
+      } else {
+        out_P(PSTR("Invalid number of arguments\r\n"));
+      }
+    } else if (argc == 1) {
+      if (entry.kind == NAME_PIN)
+        print_pin_status(&entry);
       else
-        print_register_value(argv[0]);
-    } else if (argc == 2) {
+        print_register_value(&entry);
+    } else {
       to_uppercase(argv[1]);
-      if (is_pin(argv[0])) {
-        if (is_mode(argv[1])) {
-          set_pin_mode(argv[0], argv[1]);
+      if (entry.kind == NAME_PIN) {
+        if (strcmp(argv[1], "TOGGLE") == 0) {
+          set_pins(argv[0], argv[1]);
+        } else if (is_mode(argv[1])) {
+          set_pin_mode(&entry, argv[1]);
         } else {
-          set_pin_value(argv[0], argv[1]);
+          set_pin_value(&entry, argv[1]);
         }
       } else {
-        set_register_value(argv[0], (uint8_t)strtol(argv[1], NULL, 0));
+        set_register_value(&entry, (uint8_t)strtol(argv[1], NULL, 0));
       }
-    } else {
-      printf("Invalid number of arguments\r\n");
     }
   } while (0);
 }
 
 static void process_version(mcucli_t *cli, void *user_data, int argc,
                          char *argv[]) {
-  printf("Firmware version: %s\r\n", VERSION);
+  out_line_P(PSTR("Firmware version: " VERSION));
+}
+
+static void process_time(mcucli_t *cli, void *user_data, int argc,
+                         char *argv[]) {
+  out_fmt_P(PSTR("time: %lu us\r\n"), timebase_micros());
+  out_fmt_P(PSTR("read cost: %u cycles\r\n"), timebase_read_cost());
+}
+
+static void process_idle(mcucli_t *cli, void *user_data, int argc,
+                         char *argv[]) {
+  UNUSED(cli);
+  UNUSED(user_data);
+
+  if (argc == 1 && strcmp(argv[0], "stats") == 0) {
+    idle_stats_t stats;
+    uint32_t ms;
+
+    idle_get_stats(&stats);
+    ms = stats.elapsed / 1000;
+    out_fmt_P(PSTR("idle: %lu of %lu ms, %u%%\r\n"), stats.idle / 1000, ms,
+              ms ? (uint16_t)(stats.idle / 10 / ms) : 0);
+    out_fmt_P(PSTR("sleeps: %lu, during suspend: %u\r\n"), stats.sleeps,
+              stats.suspends);
+    out_fmt_P(PSTR("wake latency: %u cycles, worst %u cycles\r\n"),
+              stats.wake_last, stats.wake_max);
+  } else if (argc == 1 && strcmp(argv[0], "reset") == 0) {
+    idle_reset_stats();
+  } else {
+    out_line_P(help_idle);
+  }
 }
 
 static void process_reboot(mcucli_t *cli, void *user_data, int argc,
@@ -264,6 +491,11 @@ static void process_reboot(mcucli_t *cli, void *user_data, int argc,
 
 static void process_bootloader(mcucli_t *cli, void *user_data, int argc,
                          char *argv[]) {
+  // nothing may interrupt into the bootloader's vector table
+  capture_stop();
+  pattern_stop();
+  events_disarm_all();
+  timebase_stop();
   usb_disable();
 
   /* Relocate the interrupt vector table */
@@ -274,6 +506,708 @@ static void process_bootloader(mcucli_t *cli, void *user_data, int argc,
   ((void (*)(void))0x7000)();
 }
 
+// The write paths usb bench compares.
+#define USB_BENCH_BULK 0 // whole lines into the TX ring
+#define USB_BENCH_BYTE 1 // one byte at a time into the TX ring
+#define USB_BENCH_LUFA 2 // CDC_Device_SendByte(), the path before the rings
+
+static uint8_t usb_bench_write(const char *data, uint16_t length,
+                               uint8_t path) {
+  if (path == USB_BENCH_BULK) {
+    return usb_send(data, length);
+  }
+
+  for (uint16_t i = 0; i < length; i++) {
+    uint8_t failed = (path == USB_BENCH_BYTE) ? usb_send(&data[i], 1)
+                                              : usb_direct_write_byte(data[i]);
+    if (failed) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static uint32_t usb_bench(uint16_t length, uint8_t path) {
+  char line[CDC_TXRX_EPSIZE];
+  uint16_t frame = 0;
+  uint16_t sent = 0;
+  uint32_t elapsed = 0;
+  uint8_t failed;
+
+  for (size_t i = 0; i < sizeof(line) - 2; i++) {
+    line[i] = 'A' + (i % 26);
+  }
+  line[sizeof(line) - 2] = '\r';
+  line[sizeof(line) - 1] = '\n';
+
+  failed = (path == USB_BENCH_LUFA) ? usb_direct_begin() : usb_flush();
+  usb_elapsed_ms(&frame);
+
+  while (!failed && sent < length) {
+    uint16_t chunk = length - sent;
+
+    if (chunk > sizeof(line)) {
+      chunk = sizeof(line);
+    }
+
+    failed = usb_bench_write(line, chunk, path);
+    sent += chunk;
+    elapsed += usb_elapsed_ms(&frame);
+  }
+
+  if (path == USB_BENCH_LUFA) {
+    failed |= usb_direct_end();
+  } else {
+    failed |= usb_flush();
+  }
+  elapsed += usb_elapsed_ms(&frame);
+
+  if (failed || elapsed == 0) {
+    return 0;
+  }
+  return ((uint32_t)sent * 1000) / elapsed;
+}
+
+static void process_usb(mcucli_t *cli, void *user_data, int argc,
+                        char *argv[]) {
+  UNUSED(user_data);
+
+  if (argc == 1 && strcmp(argv[0], "stats") == 0) {
+    usb_stats_t stats;
+    uint32_t packets;
+
+    usb_get_stats(&stats);
+    packets = stats.replies ? stats.tx_packets * 100 / stats.replies : 0;
+    out_fmt_P(PSTR("rx: %lu bytes, %u overflows\r\n"), stats.rx_bytes,
+              stats.rx_overflows);
+    out_fmt_P(PSTR("tx: %lu bytes in %lu packets, %u overflows\r\n"),
+              stats.tx_bytes, stats.tx_packets, stats.tx_overflows);
+    out_fmt_P(PSTR("replies: %lu, %lu.%02lu packets each\r\n"),
+              stats.replies, packets / 100, packets % 100);
+  } else if (argc == 2 && strcmp(argv[0], "bench") == 0) {
+    uint16_t length = (uint16_t)strtol(argv[1], NULL, 0);
+    uint32_t bulk;
+    uint32_t byte;
+    uint32_t lufa;
+
+    // the test data goes out as it comes and isn't part of the reply, which
+    // starts with the results
+    usb_tx_release(0);
+    bulk = usb_bench(length, USB_BENCH_BULK);
+    byte = usb_bench(length, USB_BENCH_BYTE);
+    lufa = usb_bench(length, USB_BENCH_LUFA);
+    usb_tx_hold();
+
+    out_fmt_P(PSTR("bulk: %lu bytes/s\r\n"), bulk);
+    out_fmt_P(PSTR("byte: %lu bytes/s\r\n"), byte);
+    out_fmt_P(PSTR("lufa byte: %lu bytes/s\r\n"), lufa);
+  } else {
+    out_line_P(help_usb);
+  }
+}
+
+// Parses one "<name>" or "<name>=<value>" batch operation, the name and value
+// are expected in upper case.
+static int8_t parse_batch_op(const char *name, const char *value,
+                             batch_op_t *op) {
+  name_entry_t entry;
+
+  if (!name_lookup(name, &entry)) {
+    return -1;
+  }
+
+  op->id = entry.id;
+
+  if (entry.kind == NAME_PIN) {
+    if (value == NULL) {
+      op->type = BATCH_READ_PIN;
+    } else if (is_mode(value)) {
+      op->type = BATCH_MODE_PIN;
+      op->value = (value[0] == 'O') ? GPIO_DIRECTION_OUT : GPIO_DIRECTION_IN;
+    } else {
+      op->type = BATCH_WRITE_PIN;
+      op->value = (uint8_t)strtol(value, NULL, 0);
+    }
+  } else {
+    if (value == NULL) {
+      op->type = BATCH_READ_REG;
+    } else {
+      op->type = BATCH_WRITE_REG;
+      op->value = (uint8_t)strtol(value, NULL, 0);
+    }
+  }
+  return 0;
+}
+
+// Runs the parsed operations without any output in between, the result of
+// each read replaces the value of its operation.
+static void run_batch(batch_op_t *ops, uint8_t num_ops) {
+  for (uint8_t i = 0; i < num_ops; i++) {
+    switch (ops[i].type) {
+    case BATCH_READ_PIN:
+      ops[i].value = gpio_get_level(ops[i].id);
+      break;
+    case BATCH_READ_REG:
+      ops[i].value = gpio_read(ops[i].id);
+      break;
+    case BATCH_WRITE_PIN:
+      gpio_set_level(ops[i].id, ops[i].value);
+      break;
+    case BATCH_MODE_PIN:
+      gpio_set_direction(ops[i].id, ops[i].value);
+      break;
+    case BATCH_WRITE_REG:
+      gpio_write(ops[i].id, ops[i].value);
+      break;
+    }
+  }
+}
+
+static void process_batch(mcucli_t *cli, void *user_data, int argc,
+                          char *argv[]) {
+  UNUSED(user_data);
+
+  batch_op_t ops[ARGUMENT_BUFFER_SIZE];
+  uint8_t num_ops = 0;
+  uint8_t atomic = 0;
+  uint8_t printed = 0;
+  int first = 0;
+
+  if (argc > 0 && strcmp(argv[0], "-a") == 0) {
+    atomic = 1;
+    first = 1;
+  }
+
+  if (argc <= first) {
+    out_line_P(help_batch);
+    return;
+  }
+
+  for (int i = first; i < argc; i++) {
+    char *value = strchr(argv[i], '=');
+
+    to_uppercase(argv[i]);
+    if (value != NULL) {
+      *value++ = '\0';
+    }
+
+    if (parse_batch_op(argv[i], value, &ops[num_ops]) < 0) {
+      out_fmt_P(PSTR("Invalid operation: %s\r\n"), argv[i]);
+      return;
+    }
+    num_ops++;
+  }
+
+  if (atomic) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { run_batch(ops, num_ops); }
+  } else {
+    run_batch(ops, num_ops);
+  }
+
+  for (uint8_t i = 0; i < num_ops; i++) {
+    const char *name = argv[first + i];
+
+    if (ops[i].type == BATCH_READ_PIN) {
+      out_fmt_P(PSTR("%S%s: %S"), printed++ ? PSTR(", ") : PSTR(""), name,
+                ops[i].value ? PSTR("HIGH") : PSTR("LOW"));
+    } else if (ops[i].type == BATCH_READ_REG) {
+      out_fmt_P(PSTR("%S%s: 0x%02X"), printed++ ? PSTR(", ") : PSTR(""), name,
+                ops[i].value);
+    }
+  }
+
+  if (printed) {
+    out_P(PSTR("\r\n"));
+  }
+}
+
+typedef struct {
+  uint8_t size;
+  uint8_t run;
+  uint8_t sample[4];
+} rle_t;
+
+static rle_t rle;
+
+static void rle_flush(void) {
+  if (rle.run > 0) {
+    usb_send(&rle.run, 1);
+    usb_send(rle.sample, rle.size);
+    rle.run = 0;
+  }
+}
+
+static void rle_sink(const uint8_t *data, uint16_t length) {
+  for (uint16_t i = 0; i < length; i += rle.size) {
+    if (rle.run > 0 && rle.run < 0xFF &&
+        memcmp(rle.sample, &data[i], rle.size) == 0) {
+      rle.run++;
+    } else {
+      rle_flush();
+      memcpy(rle.sample, &data[i], rle.size);
+      rle.run = 1;
+    }
+  }
+}
+
+static uint8_t parse_groups(const char *ports) {
+  uint8_t groups = 0;
+
+  if (strcmp(ports, "ALL") == 0) {
+    return CAPTURE_GROUP_ALL;
+  }
+
+  for (; *ports != '\0'; ports++) {
+    switch (*ports) {
+    case 'B':
+      groups |= CAPTURE_GROUP_B;
+      break;
+    case 'D':
+      groups |= CAPTURE_GROUP_D;
+      break;
+    case 'F':
+      groups |= CAPTURE_GROUP_F;
+      break;
+    case 'C':
+    case 'E':
+      groups |= CAPTURE_GROUP_CE;
+      break;
+    default:
+      return 0;
+    }
+  }
+  return groups;
+}
+
+static void stream_capture(uint8_t groups, uint32_t rate, uint32_t samples) {
+  uint8_t end = 0;
+
+  rle.size = capture_sample_size(groups);
+  rle.run = 0;
+
+  rate = capture_start(groups, rate, samples, CAPTURE_MODE_STREAM);
+  if (rate == 0) {
+    out_P(PSTR("Invalid capture settings\r\n"));
+    return;
+  }
+
+  while (capture_task(rle_sink)) {
+  }
+  rle_flush();
+  usb_send(&end, 1);
+
+  if (capture_get_state() == CAPTURE_OVERRUN) {
+    out_fmt_P(PSTR("\r\nOverrun at %lu Hz, the host did not keep up\r\n"),
+              rate);
+  } else {
+    out_fmt_P(PSTR("\r\nCaptured %lu samples at %lu Hz\r\n"), samples, rate);
+  }
+}
+
+static void print_samples(const uint8_t *samples, uint16_t length) {
+  for (uint16_t i = 0; i < length; i++) {
+    out_fmt_P(PSTR("%02X%S"), samples[i],
+              ((i & 0x0F) == 0x0F || i == length - 1) ? PSTR("\r\n")
+                                                       : PSTR(" "));
+  }
+}
+
+static void trigger_capture(int argc, char *argv[]) {
+  capture_trigger_t trigger = CAPTURE_TRIGGER_MATCH;
+  gpio_register_t reg;
+  capture_result_t result;
+  name_entry_t entry;
+  const uint8_t *samples;
+  uint16_t length;
+  uint32_t timeout = CAPTURE_TRIGGER_MAX_MS;
+  uint8_t mask;
+  uint8_t value;
+  int16_t status;
+
+  to_uppercase(argv[0]);
+  if (!name_lookup(argv[0], &entry)) {
+    out_fmt_P(PSTR("Unknown pin or register: %s\r\n"), argv[0]);
+    return;
+  }
+
+  if (entry.kind == NAME_PIN) {
+    if (argc < 3 || argc > 4) {
+      out_P(PSTR("Invalid number of arguments\r\n"));
+      return;
+    }
+    to_uppercase(argv[1]);
+    reg = GPIO_PINB + gpio_get_port(entry.id);
+    mask = gpio_get_mask(entry.id);
+    trigger = CAPTURE_TRIGGER_EDGE;
+    if (strcmp(argv[1], "RISE") == 0) {
+      value = mask;
+    } else if (strcmp(argv[1], "FALL") == 0) {
+      value = 0;
+    } else {
+      out_fmt_P(PSTR("Invalid edge: %s\r\n"), argv[1]);
+      return;
+    }
+    argc -= 2;
+    argv += 2;
+  } else {
+    if (argc < 4 || argc > 5) {
+      out_P(PSTR("Invalid number of arguments\r\n"));
+      return;
+    }
+    reg = entry.id;
+    mask = (uint8_t)strtol(argv[1], NULL, 0);
+    value = (uint8_t)strtol(argv[2], NULL, 0);
+    argc -= 3;
+    argv += 3;
+  }
+
+  if (argc == 2) {
+    timeout = strtoul(argv[1], NULL, 0);
+    if (timeout > CAPTURE_TRIGGER_MAX_MS) {
+      out_fmt_P(PSTR("Invalid timeout, at most %u ms\r\n"),
+                CAPTURE_TRIGGER_MAX_MS);
+      return;
+    }
+  }
+
+  status = capture_triggered(reg, trigger, mask, value,
+                             (uint16_t)strtoul(argv[0], NULL, 0),
+                             (uint16_t)timeout, &result);
+  if (status == CAPTURE_ERROR_TIMEOUT) {
+    out_fmt_P(PSTR("No trigger within %lu ms\r\n"), timeout);
+    return;
+  } else if (status != CAPTURE_ERROR_NONE) {
+    out_fmt_P(PSTR("Invalid capture settings, at most %u samples after the "
+                   "trigger\r\n"),
+              CAPTURE_BUFFER_SIZE - 1);
+    return;
+  }
+
+  out_fmt_P(PSTR("trigger at sample %u, %u samples after it\r\n"),
+            result.pre_samples, result.post_samples);
+  out_fmt_P(PSTR("interval: %lu.%lu cycles before, %lu.%lu cycles after\r\n"),
+            result.pre_interval / 10, result.pre_interval % 10,
+            result.post_interval / 10, result.post_interval % 10);
+  samples = capture_get_buffer(&length);
+  print_samples(samples, length);
+}
+
+static void process_capture(mcucli_t *cli, void *user_data, int argc,
+                            char *argv[]) {
+  UNUSED(cli);
+  UNUSED(user_data);
+
+  if (argc == 1 && strcmp(argv[0], "info") == 0) {
+    out_fmt_P(PSTR("buffer: %u bytes\r\n"), CAPTURE_BUFFER_SIZE);
+    out_fmt_P(PSTR("buffered rate: up to %lu Hz\r\n"), capture_max_rate());
+    for (uint8_t size = 1; size <= 4; size++) {
+      uint32_t rate = USB_TX_MAX_RATE / size;
+      if (rate > capture_max_rate()) {
+        rate = capture_max_rate();
+      }
+      out_fmt_P(PSTR("raw stream rate, %u ports: up to %lu Hz\r\n"), size,
+                rate);
+    }
+  } else if (argc == 4 && strcmp(argv[0], "stream") == 0) {
+    uint8_t groups;
+
+    to_uppercase(argv[1]);
+    groups = parse_groups(argv[1]);
+    if (groups == 0) {
+      out_fmt_P(PSTR("Invalid ports: %s\r\n"), argv[1]);
+      return;
+    }
+    stream_capture(groups, strtoul(argv[2], NULL, 0),
+                   strtoul(argv[3], NULL, 0));
+  } else if (argc >= 4 && strcmp(argv[0], "trigger") == 0) {
+    trigger_capture(argc - 1, &argv[1]);
+  } else if (argc == 1 && strcmp(argv[0], "sump") == 0) {
+    sump_enter();
+  } else {
+    out_line_P(help_capture);
+  }
+}
+
+static void new_pattern(int argc, char *argv[]) {
+  gpio_register_t regs[PATTERN_MAX_PORTS];
+  uint8_t num_ports = 0;
+  char *list = argv[0];
+  name_entry_t entry;
+
+  to_uppercase(list);
+  while (list != NULL) {
+    char *next = strchr(list, ',');
+
+    if (next != NULL) {
+      *next++ = '\0';
+    }
+
+    if (num_ports == PATTERN_MAX_PORTS || !name_lookup(list, &entry) ||
+        entry.kind != NAME_REGISTER) {
+      out_fmt_P(PSTR("Invalid register: %s\r\n"), list);
+      return;
+    }
+
+    regs[num_ports++] = entry.id;
+    list = next;
+  }
+
+  if (pattern_new(regs, num_ports,
+                  argc == 2 && strcmp(argv[1], "holds") == 0) < 0) {
+    out_P(PSTR("Failed to start a new pattern\r\n"));
+  }
+}
+
+static void add_pattern(int argc, char *argv[]) {
+  uint8_t step[PATTERN_MAX_PORTS + 1];
+  uint8_t size = pattern_step_size();
+
+  for (int i = 0; i < argc; i++) {
+    char *str = argv[i];
+    uint8_t count = 0;
+    int16_t result;
+
+    while (count < size) {
+      step[count++] = (uint8_t)strtol(str, &str, 0);
+      if (*str != ',' && *str != ':') {
+        break;
+      }
+      str++;
+    }
+
+    if (count != size || *str != '\0') {
+      out_fmt_P(PSTR("Invalid step: %s\r\n"), argv[i]);
+      return;
+    }
+
+    result = pattern_add(step);
+    if (result == PATTERN_ERROR_FULL) {
+      out_fmt_P(PSTR("The pattern is full at %d steps\r\n"), pattern_steps());
+      return;
+    } else if (result < 0) {
+      out_P(PSTR("Failed to add the step, start a new pattern first\r\n"));
+      return;
+    }
+  }
+}
+
+static void update_events(char *list, uint8_t arm) {
+  name_entry_t entry;
+
+  to_uppercase(list);
+  while (list != NULL) {
+    char *next = strchr(list, ',');
+
+    if (next != NULL) {
+      *next++ = '\0';
+    }
+
+    if (!name_lookup(list, &entry) || entry.kind != NAME_PIN ||
+        (arm ? events_arm(entry.id) : events_disarm(entry.id)) < 0) {
+      out_fmt_P(PSTR("Invalid pin: %s\r\n"), list);
+      return;
+    }
+    list = next;
+  }
+}
+
+static void measure_event_latency(char *pin, uint8_t count) {
+  name_entry_t entry;
+  uint16_t latency;
+  int16_t result;
+
+  to_uppercase(pin);
+  if (!name_lookup(pin, &entry) || entry.kind != NAME_PIN) {
+    out_fmt_P(PSTR("Invalid pin: %s\r\n"), pin);
+    return;
+  }
+
+  result = events_measure_latency(entry.id, count, &latency);
+  if (result == EVENTS_ERROR_NONE) {
+    out_fmt_P(PSTR("worst latency: %u us over %u edges\r\n"), latency, count);
+  } else if (result == EVENTS_ERROR_NOT_ARMED) {
+    out_fmt_P(PSTR("Arm %s first\r\n"), pin);
+  } else if (result == EVENTS_ERROR_NOT_OUTPUT) {
+    out_fmt_P(PSTR("%s must be an output\r\n"), pin);
+  } else if (result == EVENTS_ERROR_TIMEOUT) {
+    out_fmt_P(PSTR("No event from %s\r\n"), pin);
+  } else {
+    out_fmt_P(PSTR("Invalid pin: %s\r\n"), pin);
+  }
+}
+
+static void process_event(mcucli_t *cli, void *user_data, int argc,
+                          char *argv[]) {
+  UNUSED(cli);
+  UNUSED(user_data);
+
+  if (argc == 2 && strcmp(argv[0], "arm") == 0) {
+    update_events(argv[1], 1);
+  } else if (argc == 2 && strcmp(argv[0], "disarm") == 0) {
+    update_events(argv[1], 0);
+  } else if (argc == 1 && strcmp(argv[0], "disarm") == 0) {
+    events_disarm_all();
+  } else if (argc == 1 && strcmp(argv[0], "stats") == 0) {
+    events_stats_t stats;
+    uint32_t ms;
+
+    events_get_stats(&stats);
+    ms = stats.elapsed / 1000;
+    out_fmt_P(PSTR("events: %lu in %lu ms, %lu per second\r\n"), stats.events,
+              ms, ms ? stats.events * 1000 / ms : 0);
+    out_fmt_P(PSTR("dropped: %u\r\n"), stats.dropped);
+    out_fmt_P(PSTR("worst latency: %u us\r\n"), stats.max_latency);
+  } else if (argc == 1 && strcmp(argv[0], "reset") == 0) {
+    events_reset_stats();
+  } else if ((argc == 2 || argc == 3) && strcmp(argv[0], "latency") == 0) {
+    measure_event_latency(argv[1],
+                          (argc == 3) ? (uint8_t)strtoul(argv[2], NULL, 0)
+                                      : 100);
+  } else {
+    out_line_P(help_event);
+  }
+}
+
+static void process_pattern(mcucli_t *cli, void *user_data, int argc,
+                            char *argv[]) {
+  UNUSED(cli);
+  UNUSED(user_data);
+
+  if (argc >= 2 && argc <= 3 && strcmp(argv[0], "new") == 0) {
+    new_pattern(argc - 1, &argv[1]);
+  } else if (argc >= 2 && strcmp(argv[0], "add") == 0) {
+    add_pattern(argc - 1, &argv[1]);
+  } else if (argc == 2 && strcmp(argv[0], "load") == 0) {
+    if (pattern_load((uint16_t)strtoul(argv[1], NULL, 0)) < 0) {
+      out_fmt_P(PSTR("Failed to load, %d steps of %u bytes in %u bytes\r\n"),
+                pattern_steps(), pattern_step_size(), PATTERN_BUFFER_SIZE);
+    }
+  } else if (argc >= 2 && argc <= 3 && strcmp(argv[0], "run") == 0) {
+    uint32_t rate = pattern_start(
+        strtoul(argv[1], NULL, 0),
+        (argc == 3) ? (uint16_t)strtoul(argv[2], NULL, 0) : 0);
+
+    if (rate == 0) {
+      out_P(PSTR("Failed to start the pattern\r\n"));
+    } else {
+      out_fmt_P(PSTR("Running at %lu Hz\r\n"), rate);
+    }
+  } else if (argc <= 2 && argc >= 1 && strcmp(argv[0], "fast") == 0) {
+    uint32_t repeat = (argc == 2) ? strtoul(argv[1], NULL, 0) : 1;
+
+    if (pattern_replay(repeat) < 0) {
+      out_fmt_P(PSTR("Fast replay needs one register, no holds and at most "
+                     "%lu steps\r\n"),
+                PATTERN_REPLAY_MAX_STEPS);
+    } else {
+      out_fmt_P(PSTR("Replayed at %lu Hz\r\n"),
+                F_CPU / PATTERN_REPLAY_CYCLES);
+    }
+  } else if (argc == 1 && strcmp(argv[0], "stop") == 0) {
+    pattern_stop();
+  } else if (argc == 1 && strcmp(argv[0], "info") == 0) {
+    out_fmt_P(PSTR("steps: %d of %u bytes, %u bytes free\r\n"),
+              pattern_steps(), pattern_step_size(),
+              PATTERN_BUFFER_SIZE - pattern_steps() * pattern_step_size());
+    out_fmt_P(PSTR("state: %S\r\n"),
+              pattern_running() ? PSTR("running") : PSTR("stopped"));
+  } else {
+    out_line_P(help_pattern);
+  }
+}
+
+static void prompt_release(void) {
+  if (prompt_length > 0) {
+    cli_write(prompt, prompt_length);
+    prompt_length = 0;
+  }
+}
+
+// Replies of a command go out after the echo the CLI wrote before it.
+static int reply_write(const char *s, size_t len) {
+  if (prompt_holding) {
+    prompt_release();
+  }
+  return cli_write(s, len);
+}
+
+// Echo and prompt of the CLI. While end_command() runs a command, each write
+// is held back until the next one, so the last, the prompt, is still held
+// when the command is done.
+static int prompt_write(const char *s, size_t len) {
+  prompt_release();
+  if (prompt_holding && len <= sizeof(prompt)) {
+    memcpy(prompt, s, len);
+    prompt_length = len;
+    return len;
+  }
+  return cli_write(s, len);
+}
+
 void command_init(mcucli_t *cli, bytes_write_t write) {
-  mcucli_init(cli, NULL, &buffer, &command_set, write, unknown_command);
+  // replies take the same way out as the CLI's echo and prompt
+  cli_write = write;
+  prompt_length = 0;
+  out_init(reply_write);
+  mcucli_init(cli, NULL, &buffer, &command_set, prompt_write,
+              unknown_command);
+}
+
+// Runs the command typed so far and prints ;<n> after its output, before the
+// prompt the CLI prints after it.
+static void end_command(mcucli_t *cli) {
+  prompt_holding = 1;
+  mcucli_putc(cli, '\r');
+  prompt_holding = 0;
+  out_fmt_P(PSTR(";%u\r\n"), list_index++);
+  prompt_release();
+  list_pending = 0;
+}
+
+/** Feeds a received byte to the CLI. A COMMAND_SEPARATOR runs the command
+ * before it at once, like a line end, and marks the end of its output with
+ * a line ;<n>. The last command of a line with separators gets the line too,
+ * so a host can send a whole script in one packet and still match every reply
+ * to its command. Only the command being typed is kept in the line buffer, a
+ * list can be any length. Returns 1 if the byte ran a command, 0 for every
+ * other byte and for an empty command.
+ */
+uint8_t command_putc(mcucli_t *cli, uint8_t c) {
+  uint8_t ran = 0;
+
+  if (c == COMMAND_SEPARATOR) {
+    ran = list_pending;
+    end_command(cli);
+  } else if (c == '\r' || c == '\n') {
+    ran = list_pending;
+    if (list_index > 0 && list_pending) {
+      end_command(cli);
+    } else {
+      mcucli_putc(cli, c);
+    }
+    list_index = 0;
+    list_pending = 0;
+  } else {
+    if (c != ' ') {
+      list_pending = 1;
+    }
+    mcucli_putc(cli, c);
+  }
+  return ran;
+}
+
+/** Prints the pin edges queued since the last call. Called from the main loop
+ * while the port is in CLI mode.
+ */
+void command_task(void) {
+  event_t event;
+
+  while (events_get(&event)) {
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      if (event.changed & _BV(bit)) {
+        out_fmt_P(PSTR("event P%c%u %u %lu\r\n"), 'B' + event.port, bit,
+                  (event.level >> bit) & 1, event.time);
+      }
+    }
+  }
 }
@@ -4,5 +4,7 @@
 #include "mcucli.h"
 
 void command_init(mcucli_t *cli, bytes_write_t write);
+uint8_t command_putc(mcucli_t *cli, uint8_t c);
+void command_task(void);
 
 #endif // _COMMAND_H_
@@ -75,7 +75,7 @@
 //		#define DEVICE_STATE_AS_GPIOR            {Insert Value Here}
 #define FIXED_NUM_CONFIGURATIONS 1
 //		#define CONTROL_ONLY_DEVICE
-#define INTERRUPT_CONTROL_ENDPOINT
+//		#define INTERRUPT_CONTROL_ENDPOINT
 //		#define NO_DEVICE_REMOTE_WAKEUP
 //		#define NO_DEVICE_SELF_POWER
 
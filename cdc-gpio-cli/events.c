@@ -0,0 +1,234 @@
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <stddef.h>
+#include <util/atomic.h>
+
+#include "events.h"
+#include "timebase.h"
+
+// How long events_measure_latency() waits for each of its own edges.
+#define EVENTS_PROBE_TIMEOUT_US 10000
+
+typedef struct {
+  volatile uint8_t head; // written by the pin interrupts only
+  volatile uint8_t tail; // written by events_get() only
+  uint8_t pcint_level;   // PINB when PCINT0 last ran
+  uint8_t probe_port;
+  volatile uint8_t probe_mask; // the edge events_measure_latency() waits for
+  volatile uint32_t probe_time;
+  uint32_t reset_time;
+  events_stats_t stats;
+} events_t;
+
+static event_t queue[EVENTS_QUEUE_SIZE];
+static events_t events;
+
+static void push(uint32_t time, uint8_t port, uint8_t changed, uint8_t level) {
+  uint8_t head = events.head;
+  uint8_t next = (head + 1) & (EVENTS_QUEUE_SIZE - 1);
+
+  if (port == events.probe_port && (changed & events.probe_mask)) {
+    changed &= ~events.probe_mask;
+    events.probe_time = time;
+    events.probe_mask = 0;
+    if (changed == 0) {
+      return;
+    }
+  }
+
+  events.stats.events++;
+  if (next == events.tail) {
+    events.stats.dropped++;
+    return;
+  }
+
+  queue[head].time = time;
+  queue[head].port = port;
+  queue[head].changed = changed;
+  queue[head].level = level;
+  events.head = next;
+}
+
+// PB0 to PB7 share one pin change interrupt, the changed pins are found by
+// comparing with the last level. A pulse shorter than the interrupt latency
+// changes nothing by then and is counted as dropped.
+ISR(PCINT0_vect) {
+  uint32_t time = timebase_micros();
+  uint8_t level = PINB;
+  uint8_t changed = (level ^ events.pcint_level) & PCMSK0;
+
+  events.pcint_level = level;
+  if (changed == 0) {
+    events.stats.dropped++;
+    return;
+  }
+  push(time, 0, changed, level);
+}
+
+ISR(INT0_vect) { push(timebase_micros(), 2, _BV(PD0), PIND); }
+ISR(INT1_vect) { push(timebase_micros(), 2, _BV(PD1), PIND); }
+ISR(INT2_vect) { push(timebase_micros(), 2, _BV(PD2), PIND); }
+ISR(INT3_vect) { push(timebase_micros(), 2, _BV(PD3), PIND); }
+ISR(INT6_vect) { push(timebase_micros(), 3, _BV(PE6), PINE); }
+
+// The enable register of the interrupt behind a pin, NULL if it has none.
+// INT0 to INT3 and INT6 sit at the same bit in EIMSK as PD0 to PD3 and PE6.
+static volatile uint8_t *enable_register(uint8_t port, uint8_t mask) {
+  if (port == 0) {
+    return &PCMSK0;
+  }
+  if ((port == 2 && mask <= _BV(PD3)) || (port == 3 && mask == _BV(PE6))) {
+    return &EIMSK;
+  }
+  return NULL;
+}
+
+void events_init(void) { events_reset_stats(); }
+
+/** Queues an event on every edge of the pin. Only PB0 to PB7 (PCINT0 to
+ * PCINT7), PD0 to PD3 (INT0 to INT3) and PE6 (INT6) can be armed.
+ */
+int16_t events_arm(gpio_pin_t pin) {
+  int16_t port = gpio_get_port(pin);
+  uint8_t mask = gpio_get_mask(pin);
+  volatile uint8_t *enable;
+
+  if (port < 0 || (enable = enable_register(port, mask)) == NULL) {
+    return EVENTS_ERROR_INVALID_PIN;
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (port == 0) {
+      events.pcint_level = PINB;
+      PCIFR = _BV(PCIF0);
+      PCICR |= _BV(PCIE0);
+    } else if (port == 2) {
+      // ISCn1:0 = 01, any edge, two bits per INTn from bit 2n
+      EICRA = (EICRA & ~(3 * mask * mask)) | (mask * mask);
+      EIFR = mask;
+    } else {
+      EICRB = (EICRB & ~(3 << ISC60)) | _BV(ISC60);
+      EIFR = mask;
+    }
+    *enable |= mask;
+  }
+  return EVENTS_ERROR_NONE;
+}
+
+int16_t events_disarm(gpio_pin_t pin) {
+  int16_t port = gpio_get_port(pin);
+  uint8_t mask = gpio_get_mask(pin);
+  volatile uint8_t *enable;
+
+  if (port < 0 || (enable = enable_register(port, mask)) == NULL) {
+    return EVENTS_ERROR_INVALID_PIN;
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    *enable &= ~mask;
+    if (PCMSK0 == 0) {
+      PCICR &= ~_BV(PCIE0);
+    }
+  }
+  return EVENTS_ERROR_NONE;
+}
+
+void events_disarm_all(void) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    PCICR &= ~_BV(PCIE0);
+    PCMSK0 = 0;
+    EIMSK &= ~(_BV(INT0) | _BV(INT1) | _BV(INT2) | _BV(INT3) | _BV(INT6));
+  }
+}
+
+/** Returns 1 while events are queued for events_get(). */
+uint8_t events_pending(void) { return events.tail != events.head; }
+
+/** Takes the oldest queued event, returns 0 if there is none. */
+uint8_t events_get(event_t *event) {
+  uint8_t tail = events.tail;
+
+  if (tail == events.head) {
+    return 0;
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { *event = queue[tail]; }
+  events.tail = (tail + 1) & (EVENTS_QUEUE_SIZE - 1);
+  return 1;
+}
+
+void events_get_stats(events_stats_t *stats) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    *stats = events.stats;
+    stats->elapsed = timebase_micros() - events.reset_time;
+  }
+}
+
+void events_reset_stats(void) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    events.stats.events = 0;
+    events.stats.dropped = 0;
+    events.stats.max_latency = 0;
+    events.reset_time = timebase_micros();
+  }
+}
+
+/** Measures the delay from an edge to its timestamp by toggling an armed
+ * output pin count times, each edge is timed and not queued. The edges are
+ * made with interrupts on, so a USB interrupt just before one of them shows
+ * up in the worst case, as it would for an outside edge.
+ */
+int16_t events_measure_latency(gpio_pin_t pin, uint8_t count,
+                               uint16_t *latency) {
+  int16_t port = gpio_get_port(pin);
+  uint8_t mask = gpio_get_mask(pin);
+  volatile uint8_t *enable;
+  volatile uint8_t *toggle;
+  uint16_t worst = 0;
+
+  if (port < 0 || (enable = enable_register(port, mask)) == NULL) {
+    return EVENTS_ERROR_INVALID_PIN;
+  }
+
+  if ((*enable & mask) == 0) {
+    return EVENTS_ERROR_NOT_ARMED;
+  }
+
+  if (gpio_get_direction(pin) != GPIO_DIRECTION_OUT) {
+    return EVENTS_ERROR_NOT_OUTPUT;
+  }
+
+  // writing PINx toggles the output, an armed pin sees its own edges
+  toggle = gpio_get_address(GPIO_PINB + port);
+
+  for (uint8_t i = 0; i < count; i++) {
+    uint32_t start;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      events.probe_port = port;
+      events.probe_mask = mask;
+    }
+
+    start = timebase_micros();
+    *toggle = mask;
+
+    while (events.probe_mask != 0) {
+      if (timebase_micros() - start > EVENTS_PROBE_TIMEOUT_US) {
+        events.probe_mask = 0;
+        return EVENTS_ERROR_TIMEOUT;
+      }
+    }
+
+    if (events.probe_time - start > worst) {
+      worst = events.probe_time - start;
+    }
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (worst > events.stats.max_latency) {
+      events.stats.max_latency = worst;
+    }
+  }
+  *latency = worst;
+  return EVENTS_ERROR_NONE;
+}
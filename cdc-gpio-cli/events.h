@@ -0,0 +1,45 @@
+#ifndef _EVENTS_H_
+#define _EVENTS_H_
+
+#include <stdint.h>
+
+#include "gpio.h"
+
+#define EVENTS_ERROR_NONE 0
+#define EVENTS_ERROR_INVALID_PIN -1
+#define EVENTS_ERROR_NOT_ARMED -2
+#define EVENTS_ERROR_NOT_OUTPUT -3
+#define EVENTS_ERROR_TIMEOUT -4
+
+// Events queued between the pin interrupts and the main loop, a power of two
+// no larger than 256.
+#ifndef EVENTS_QUEUE_SIZE
+#define EVENTS_QUEUE_SIZE 32
+#endif
+
+typedef struct {
+  uint32_t time;   // timebase_micros() when the interrupt handler started
+  uint8_t port;    // 0 for port B up to 4 for port F, like gpio_get_port()
+  uint8_t changed; // the armed bits of the port that changed
+  uint8_t level;   // the port input after the change
+} event_t;
+
+typedef struct {
+  uint32_t events;      // edges seen since the last reset
+  uint32_t elapsed;     // microseconds since the last reset
+  uint16_t dropped;     // edges lost to a full queue or a too short pulse
+  uint16_t max_latency; // worst edge to timestamp delay measured, in us
+} events_stats_t;
+
+void events_init(void);
+int16_t events_arm(gpio_pin_t pin);
+int16_t events_disarm(gpio_pin_t pin);
+void events_disarm_all(void);
+uint8_t events_get(event_t *event);
+uint8_t events_pending(void);
+void events_get_stats(events_stats_t *stats);
+void events_reset_stats(void);
+int16_t events_measure_latency(gpio_pin_t pin, uint8_t count,
+                               uint16_t *latency);
+
+#endif // _EVENTS_H_
@@ -0,0 +1,88 @@
+from __future__ import print_function
+
+import argparse, os
+
+# must match NAME_SIZE in names.h, including the terminating zero
+NAME_SIZE = 6
+EMPTY_SLOT = 0xFF
+
+def parse(spec):
+  commands, names = [], []
+  with open(spec) as file:
+    for number, line in enumerate(file, 1):
+      fields = line.split('#', 1)[0].split()
+      if not fields:
+        continue
+      if fields[0] == 'command' and len(fields) == 4:
+        commands.append(fields[1:])
+      elif fields[0] in ('register', 'pin') and len(fields) == 3:
+        assert len(fields[1]) < NAME_SIZE, '{}:{}: {} is too long.'.format(spec, number, fields[1])
+        assert fields[1] == fields[1].upper(), '{}:{}: {} must be upper case.'.format(spec, number, fields[1])
+        names.append((fields[1], 'NAME_' + fields[0].upper(), fields[2]))
+      else:
+        assert False, '{}:{}: can\'t parse "{}".'.format(spec, number, line.strip())
+  assert len(set(name for name, _, _ in names)) == len(names), 'duplicated names in {}.'.format(spec)
+  assert len(names) < EMPTY_SLOT, 'too many names in {}.'.format(spec)
+  return commands, names
+
+def name_hash(name, seed, multiplier, slots):
+  # the same 8-bit hash as name_hash() in names.c
+  value = seed
+  for c in name:
+    value = (value * multiplier + ord(c)) & 0xFF
+  return value & (slots - 1)
+
+def perfect_hash(names):
+  slots = 1
+  while slots < len(names):
+    slots *= 2
+  while slots <= 256:
+    for multiplier in range(3, 256, 2):
+      for seed in range(256):
+        table = [EMPTY_SLOT] * slots
+        for index, name in enumerate(names):
+          slot = name_hash(name, seed, multiplier, slots)
+          if table[slot] != EMPTY_SLOT:
+            break
+          table[slot] = index
+        else:
+          return seed, multiplier, table
+    slots *= 2
+  assert False, 'no perfect hash found, try fewer names.'
+
+def generate(spec, output):
+  commands, names = parse(spec)
+  seed, multiplier, table = perfect_hash([name for name, _, _ in names])
+  lines = [
+    '// Generated by gen-names.py from {}, do not edit.'.format(os.path.basename(spec)),
+    '#ifndef _NAMES_TABLE_H_',
+    '#define _NAMES_TABLE_H_',
+    '',
+    '#define NAMES_HASH_SEED {}'.format(seed),
+    '#define NAMES_HASH_MULTIPLIER {}'.format(multiplier),
+    '#define NAMES_SLOT_COUNT {}'.format(len(table)),
+    '#define NAMES_COUNT {}'.format(len(names)),
+    '',
+    '#define NAMES_COMMANDS \\',
+  ]
+  lines += ['  {{"{}", {}, {}}}, \\'.format(name, help, handler) for name, handler, help in commands]
+  lines += ['', '#define NAMES_ENTRIES \\']
+  lines += ['  {{"{}", {}, {}}}, \\'.format(name, kind, value) for name, kind, value in names]
+  lines += ['', '#define NAMES_SLOTS \\']
+  lines += ['  ' + ', '.join(str(index) for index in table[i:i + 16]) + ', \\' for i in range(0, len(table), 16)]
+  lines += ['', '#endif // _NAMES_TABLE_H_', '']
+  content = '\n'.join(lines)
+  # only touch the output when it changes, so make doesn't rebuild every time
+  if os.path.isfile(output):
+    with open(output) as file:
+      if file.read() == content:
+        return
+  with open(output, 'w') as file:
+    file.write(content)
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser()
+  parser.add_argument('spec', type=str, help='The name specification file.')
+  parser.add_argument('output', type=str, help='The generated header file.')
+  args = parser.parse_args()
+  generate(args.spec, args.output)
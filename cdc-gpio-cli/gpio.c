@@ -1,45 +1,97 @@
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include <stddef.h>
+#include <util/atomic.h>
 
 #include "gpio.h"
 
+#define GPIO_PORTC_MASK (_BV(PC6) | _BV(PC7))
+#define GPIO_PORTE_MASK (_BV(PE2) | _BV(PE6))
+#define GPIO_PORTF_MASK                                                        \
+  (_BV(PF0) | _BV(PF1) | _BV(PF4) | _BV(PF5) | _BV(PF6) | _BV(PF7))
+
+typedef struct {
+  volatile uint8_t *address;
+  uint8_t writable; // the bits gpio_write may change, 0 for read only
+} gpio_register_map_t;
+
 typedef struct {
-  gpio_pin_t pin;
-  gpio_register_t direction;
-  gpio_register_t level;
-  uint8_t bit;
+  volatile uint8_t *direction;
+  volatile uint8_t *level;
+  uint8_t mask;
+  uint8_t port; // 0 for port B up to 4 for port F
 } gpio_pin_map_t;
 
-static gpio_pin_map_t gpio_pin_map[] = {
-    {GPIO_PB0, GPIO_DDRB, GPIO_PORTB, PB0},
-    {GPIO_PB1, GPIO_DDRB, GPIO_PORTB, PB1},
-    {GPIO_PB2, GPIO_DDRB, GPIO_PORTB, PB2},
-    {GPIO_PB3, GPIO_DDRB, GPIO_PORTB, PB3},
-    {GPIO_PB4, GPIO_DDRB, GPIO_PORTB, PB4},
-    {GPIO_PB5, GPIO_DDRB, GPIO_PORTB, PB5},
-    {GPIO_PB6, GPIO_DDRB, GPIO_PORTB, PB6},
-    {GPIO_PB7, GPIO_DDRB, GPIO_PORTB, PB7},
-    {GPIO_PC6, GPIO_DDRC, GPIO_PORTC, PC6},
-    {GPIO_PC7, GPIO_DDRC, GPIO_PORTC, PC7},
-    {GPIO_PD0, GPIO_DDRD, GPIO_PORTD, PD0},
-    {GPIO_PD1, GPIO_DDRD, GPIO_PORTD, PD1},
-    {GPIO_PD2, GPIO_DDRD, GPIO_PORTD, PD2},
-    {GPIO_PD3, GPIO_DDRD, GPIO_PORTD, PD3},
-    {GPIO_PD4, GPIO_DDRD, GPIO_PORTD, PD4},
-    {GPIO_PD5, GPIO_DDRD, GPIO_PORTD, PD5},
-    {GPIO_PD6, GPIO_DDRD, GPIO_PORTD, PD6},
-    {GPIO_PD7, GPIO_DDRD, GPIO_PORTD, PD7},
-    {GPIO_PE2, GPIO_DDRE, GPIO_PORTE, PE2},
-    {GPIO_PE6, GPIO_DDRE, GPIO_PORTE, PE6},
-    {GPIO_PF0, GPIO_DDRF, GPIO_PORTF, PF0},
-    {GPIO_PF1, GPIO_DDRF, GPIO_PORTF, PF1},
-    {GPIO_PF4, GPIO_DDRF, GPIO_PORTF, PF4},
-    {GPIO_PF5, GPIO_DDRF, GPIO_PORTF, PF5},
-    {GPIO_PF6, GPIO_DDRF, GPIO_PORTF, PF6},
-    {GPIO_PF7, GPIO_DDRF, GPIO_PORTF, PF7},
+// Both tables live in flash and are indexed directly by gpio_register_t and
+// gpio_pin_t, so every lookup is a bounds check plus a table read.
+static const gpio_register_map_t gpio_register_map[] PROGMEM = {
+    [GPIO_UNKNOWN_REG] = {NULL, 0x00},
+    [GPIO_MCUCR] = {&MCUCR, _BV(PUD)},
+    [GPIO_DDRB] = {&DDRB, 0xFF},
+    [GPIO_DDRC] = {&DDRC, GPIO_PORTC_MASK},
+    [GPIO_DDRD] = {&DDRD, 0xFF},
+    [GPIO_DDRE] = {&DDRE, GPIO_PORTE_MASK},
+    [GPIO_DDRF] = {&DDRF, GPIO_PORTF_MASK},
+    [GPIO_PORTB] = {&PORTB, 0xFF},
+    [GPIO_PORTC] = {&PORTC, GPIO_PORTC_MASK},
+    [GPIO_PORTD] = {&PORTD, 0xFF},
+    [GPIO_PORTE] = {&PORTE, GPIO_PORTE_MASK},
+    [GPIO_PORTF] = {&PORTF, GPIO_PORTF_MASK},
+    [GPIO_PINB] = {&PINB, 0x00},
+    [GPIO_PINC] = {&PINC, 0x00},
+    [GPIO_PIND] = {&PIND, 0x00},
+    [GPIO_PINE] = {&PINE, 0x00},
+    [GPIO_PINF] = {&PINF, 0x00},
+};
+
+static const gpio_pin_map_t gpio_pin_map[] PROGMEM = {
+    [GPIO_UNKNOWN_PIN] = {NULL, NULL, 0x00, 0},
+    [GPIO_PB0] = {&DDRB, &PORTB, _BV(PB0), 0},
+    [GPIO_PB1] = {&DDRB, &PORTB, _BV(PB1), 0},
+    [GPIO_PB2] = {&DDRB, &PORTB, _BV(PB2), 0},
+    [GPIO_PB3] = {&DDRB, &PORTB, _BV(PB3), 0},
+    [GPIO_PB4] = {&DDRB, &PORTB, _BV(PB4), 0},
+    [GPIO_PB5] = {&DDRB, &PORTB, _BV(PB5), 0},
+    [GPIO_PB6] = {&DDRB, &PORTB, _BV(PB6), 0},
+    [GPIO_PB7] = {&DDRB, &PORTB, _BV(PB7), 0},
+    [GPIO_PC6] = {&DDRC, &PORTC, _BV(PC6), 1},
+    [GPIO_PC7] = {&DDRC, &PORTC, _BV(PC7), 1},
+    [GPIO_PD0] = {&DDRD, &PORTD, _BV(PD0), 2},
+    [GPIO_PD1] = {&DDRD, &PORTD, _BV(PD1), 2},
+    [GPIO_PD2] = {&DDRD, &PORTD, _BV(PD2), 2},
+    [GPIO_PD3] = {&DDRD, &PORTD, _BV(PD3), 2},
+    [GPIO_PD4] = {&DDRD, &PORTD, _BV(PD4), 2},
+    [GPIO_PD5] = {&DDRD, &PORTD, _BV(PD5), 2},
+    [GPIO_PD6] = {&DDRD, &PORTD, _BV(PD6), 2},
+    [GPIO_PD7] = {&DDRD, &PORTD, _BV(PD7), 2},
+    [GPIO_PE2] = {&DDRE, &PORTE, _BV(PE2), 3},
+    [GPIO_PE6] = {&DDRE, &PORTE, _BV(PE6), 3},
+    [GPIO_PF0] = {&DDRF, &PORTF, _BV(PF0), 4},
+    [GPIO_PF1] = {&DDRF, &PORTF, _BV(PF1), 4},
+    [GPIO_PF4] = {&DDRF, &PORTF, _BV(PF4), 4},
+    [GPIO_PF5] = {&DDRF, &PORTF, _BV(PF5), 4},
+    [GPIO_PF6] = {&DDRF, &PORTF, _BV(PF6), 4},
+    [GPIO_PF7] = {&DDRF, &PORTF, _BV(PF7), 4},
 };
 
-static size_t num_gpio_pins = sizeof(gpio_pin_map) / sizeof(gpio_pin_map_t);
+#define NUM_GPIO_REGISTERS                                                     \
+  (sizeof(gpio_register_map) / sizeof(gpio_register_map_t))
+#define NUM_GPIO_PINS (sizeof(gpio_pin_map) / sizeof(gpio_pin_map_t))
+
+#define IS_VALID_REGISTER(reg)                                                 \
+  ((reg) != GPIO_UNKNOWN_REG && (reg) < NUM_GPIO_REGISTERS)
+#define IS_VALID_PIN(pin) ((pin) != GPIO_UNKNOWN_PIN && (pin) < NUM_GPIO_PINS)
+
+static inline volatile uint8_t *read_address(volatile uint8_t *const *field) {
+  return (volatile uint8_t *)pgm_read_word(field);
+}
+
+// The read-modify-write runs with interrupts disabled, so an interrupt
+// handler touching the same register can't lose its update.
+static inline void write_bits(volatile uint8_t *reg, uint8_t mask,
+                              uint8_t value) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { *reg = (*reg & ~mask) | (value & mask); }
+}
 
 int16_t gpio_init(void) {
   gpio_write(GPIO_MCUCR, 0x00);
@@ -57,180 +109,146 @@ int16_t gpio_init(void) {
 }
 
 int16_t gpio_set_direction(gpio_pin_t pin, uint8_t value) {
-  uint8_t bit = 0;
-  int16_t original = 0;
-  gpio_register_t reg = GPIO_UNKNOWN_REG;
-
-  for (int i = 0; i < num_gpio_pins; i++) {
-    if (gpio_pin_map[i].pin == pin) {
-      bit = gpio_pin_map[i].bit;
-      reg = gpio_pin_map[i].direction;
-      break;
-    }
+  if (!IS_VALID_PIN(pin)) {
+    return GPIO_ERROR_INVALID_PIN;
   }
 
-  if (reg == GPIO_UNKNOWN_REG) {
+  write_bits(read_address(&gpio_pin_map[pin].direction),
+             pgm_read_byte(&gpio_pin_map[pin].mask), (value & 1) ? 0xFF : 0);
+  return GPIO_ERROR_NONE;
+}
+
+int16_t gpio_get_direction(gpio_pin_t pin) {
+  if (!IS_VALID_PIN(pin)) {
     return GPIO_ERROR_INVALID_PIN;
   }
 
-  original = gpio_read(reg);
+  return (*read_address(&gpio_pin_map[pin].direction) &
+          pgm_read_byte(&gpio_pin_map[pin].mask)) != 0;
+}
 
-  if (original < 0) {
-    return original;
+int16_t gpio_set_level(gpio_pin_t pin, uint8_t value) {
+  if (!IS_VALID_PIN(pin)) {
+    return GPIO_ERROR_INVALID_PIN;
   }
 
-  return gpio_write(reg, BIT_RESET(original, bit, value));
+  write_bits(read_address(&gpio_pin_map[pin].level),
+             pgm_read_byte(&gpio_pin_map[pin].mask), (value & 1) ? 0xFF : 0);
+  return GPIO_ERROR_NONE;
 }
 
-int16_t gpio_get_direction(gpio_pin_t pin) {
-  uint8_t bit = 0;
-  uint8_t directions = 0;
-  gpio_register_t reg = GPIO_UNKNOWN_REG;
+int16_t gpio_get_level(gpio_pin_t pin) {
+  if (!IS_VALID_PIN(pin)) {
+    return GPIO_ERROR_INVALID_PIN;
+  }
 
-  for (int i = 0; i < num_gpio_pins; i++) {
-    if (gpio_pin_map[i].pin == pin) {
-      bit = gpio_pin_map[i].bit;
-      reg = gpio_pin_map[i].direction;
-      break;
-    }
+  return (*read_address(&gpio_pin_map[pin].level) &
+          pgm_read_byte(&gpio_pin_map[pin].mask)) != 0;
+}
+
+int16_t gpio_get_port(gpio_pin_t pin) {
+  if (!IS_VALID_PIN(pin)) {
+    return GPIO_ERROR_INVALID_PIN;
   }
 
-  if (reg == GPIO_UNKNOWN_REG) {
+  return pgm_read_byte(&gpio_pin_map[pin].port);
+}
+
+int16_t gpio_get_mask(gpio_pin_t pin) {
+  if (!IS_VALID_PIN(pin)) {
     return GPIO_ERROR_INVALID_PIN;
   }
 
-  directions = gpio_read(reg);
+  return pgm_read_byte(&gpio_pin_map[pin].mask);
+}
+
+volatile uint8_t *gpio_get_address(gpio_register_t reg) {
+  if (!IS_VALID_REGISTER(reg)) {
+    return NULL;
+  }
+
+  return read_address(&gpio_register_map[reg].address);
+}
+
+int16_t gpio_get_writable(gpio_register_t reg) {
+  if (!IS_VALID_REGISTER(reg)) {
+    return GPIO_ERROR_INVALID_REG;
+  }
 
-  return (directions < 0) ? directions : (directions >> bit) & 1;
+  return pgm_read_byte(&gpio_register_map[reg].writable);
 }
 
-int16_t gpio_set_level(gpio_pin_t pin, uint8_t value) {
-  uint8_t bit = 0;
-  int16_t original = 0;
-  gpio_register_t reg = GPIO_UNKNOWN_REG;
+int16_t gpio_write(gpio_register_t reg, uint8_t value) {
+  uint8_t writable;
 
-  for (int i = 0; i < num_gpio_pins; i++) {
-    if (gpio_pin_map[i].pin == pin) {
-      bit = gpio_pin_map[i].bit;
-      reg = gpio_pin_map[i].level;
-      break;
-    }
+  if (!IS_VALID_REGISTER(reg)) {
+    return GPIO_ERROR_INVALID_REG;
   }
 
-  if (reg == GPIO_UNKNOWN_REG) {
-    return GPIO_ERROR_INVALID_PIN;
+  writable = pgm_read_byte(&gpio_register_map[reg].writable);
+  if (writable == 0) {
+    return GPIO_ERROR_INVALID_REG;
   }
 
-  original = gpio_read(reg);
+  *read_address(&gpio_register_map[reg].address) = value & writable;
+  return GPIO_ERROR_NONE;
+}
 
-  if (original < 0) {
-    return original;
+int16_t gpio_read(gpio_register_t reg) {
+  if (!IS_VALID_REGISTER(reg)) {
+    return GPIO_ERROR_INVALID_REG;
   }
 
-  return gpio_write(reg, BIT_RESET(original, bit, value));
+  return *read_address(&gpio_register_map[reg].address);
 }
 
-int16_t gpio_get_level(gpio_pin_t pin) {
-  uint8_t bit = 0;
-  uint16_t result = 0;
-  gpio_register_t reg = GPIO_UNKNOWN_REG;
+int16_t gpio_write_mask(gpio_register_t reg, uint8_t mask, uint8_t value) {
+  uint8_t writable;
 
-  for (int i = 0; i < num_gpio_pins; i++) {
-    if (gpio_pin_map[i].pin == pin) {
-      bit = gpio_pin_map[i].bit;
-      reg = gpio_pin_map[i].level;
-      break;
-    }
+  if (!IS_VALID_REGISTER(reg)) {
+    return GPIO_ERROR_INVALID_REG;
   }
 
-  if (reg == GPIO_UNKNOWN_REG) {
-    return GPIO_ERROR_INVALID_PIN;
+  writable = pgm_read_byte(&gpio_register_map[reg].writable);
+  if (writable == 0) {
+    return GPIO_ERROR_INVALID_REG;
   }
 
-  result = gpio_read(reg);
+  write_bits(read_address(&gpio_register_map[reg].address), mask & writable,
+             value);
+  return GPIO_ERROR_NONE;
+}
+
+int16_t gpio_set_mask(gpio_register_t reg, uint8_t mask) {
+  return gpio_write_mask(reg, mask, 0xFF);
+}
 
-  return (result < 0) ? result : (result >> bit) & 1;
+int16_t gpio_clear_mask(gpio_register_t reg, uint8_t mask) {
+  return gpio_write_mask(reg, mask, 0x00);
 }
 
-int16_t gpio_write(gpio_register_t reg, uint8_t value) {
-  switch (reg) {
-  case GPIO_MCUCR:
-    MCUCR = value & _BV(PUD);
-    break;
-  case GPIO_DDRB:
-    DDRB = value;
-    break;
-  case GPIO_DDRC:
-    DDRC = value & (_BV(PC6) | _BV(PC7));
-    break;
-  case GPIO_DDRD:
-    DDRD = value;
-    break;
-  case GPIO_DDRE:
-    DDRE = value & (_BV(PE2) | _BV(PE6));
-    break;
-  case GPIO_DDRF:
-    DDRF = value &
-           (_BV(PF0) | _BV(PF1) | _BV(PF4) | _BV(PF5) | _BV(PF6) | _BV(PF7));
-    break;
-  case GPIO_PORTB:
-    PORTB = value;
-    break;
-  case GPIO_PORTC:
-    PORTC = value & (_BV(PC6) | _BV(PC7));
-    break;
-  case GPIO_PORTD:
-    PORTD = value;
-    break;
-  case GPIO_PORTE:
-    PORTE = value & (_BV(PE2) | _BV(PE6));
-    break;
-  case GPIO_PORTF:
-    PORTF = value &
-            (_BV(PF0) | _BV(PF1) | _BV(PF4) | _BV(PF5) | _BV(PF6) | _BV(PF7));
-    break;
-  default:
+int16_t gpio_toggle_mask(gpio_register_t reg, uint8_t mask) {
+  uint8_t writable;
+
+  if (!IS_VALID_REGISTER(reg)) {
     return GPIO_ERROR_INVALID_REG;
   }
-  return GPIO_ERROR_NONE;
-}
 
-int16_t gpio_read(gpio_register_t reg) {
-  switch (reg) {
-  case GPIO_MCUCR:
-    return MCUCR;
-  case GPIO_DDRB:
-    return DDRB;
-  case GPIO_DDRC:
-    return DDRC;
-  case GPIO_DDRD:
-    return DDRD;
-  case GPIO_DDRE:
-    return DDRE;
-  case GPIO_DDRF:
-    return DDRF;
-  case GPIO_PORTB:
-    return PORTB;
-  case GPIO_PORTC:
-    return PORTC;
-  case GPIO_PORTD:
-    return PORTD;
-  case GPIO_PORTE:
-    return PORTE;
-  case GPIO_PORTF:
-    return PORTF;
-  case GPIO_PINB:
-    return PINB;
-  case GPIO_PINC:
-    return PINC;
-  case GPIO_PIND:
-    return PIND;
-  case GPIO_PINE:
-    return PINE;
-  case GPIO_PINF:
-    return PINF;
-  default:
+  writable = pgm_read_byte(&gpio_register_map[reg].writable);
+  if (writable == 0) {
     return GPIO_ERROR_INVALID_REG;
   }
-  return GPIO_ERROR_INVALID_REG;
+
+  mask &= writable;
+
+  if (reg >= GPIO_PORTB && reg <= GPIO_PORTF) {
+    // writing ones to PINx toggles the PORTx bits in a single store
+    *read_address(&gpio_register_map[reg - GPIO_PORTB + GPIO_PINB].address) =
+        mask;
+  } else {
+    volatile uint8_t *address = read_address(&gpio_register_map[reg].address);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { *address ^= mask; }
+  }
+  return GPIO_ERROR_NONE;
 }
@@ -83,8 +83,32 @@ int16_t gpio_get_direction(gpio_pin_t pin);
 int16_t gpio_set_level(gpio_pin_t pin, uint8_t value);
 int16_t gpio_get_level(gpio_pin_t pin);
 
+int16_t gpio_get_port(gpio_pin_t pin);
+int16_t gpio_get_mask(gpio_pin_t pin);
+
+/* The I/O address of a register, NULL if it is unknown. For code that reads
+ * a port in a tight loop. */
+volatile uint8_t *gpio_get_address(gpio_register_t reg);
+
+/* The bits gpio_write() may change, 0 for read only registers. */
+int16_t gpio_get_writable(gpio_register_t reg);
+
 /* Low level APIs */
 int16_t gpio_write(gpio_register_t reg, uint8_t value);
 int16_t gpio_read(gpio_register_t reg);
 
+/*
+ * Masked APIs, only the bits set in mask are changed. They are safe against
+ * interrupt handlers using the same register: set, clear and write disable
+ * interrupts around a single load, modify and store of the register, which
+ * keeps interrupts off for about 10 cycles (0.6 us at 16 MHz) including the
+ * SREG save and restore. Toggling PORTx bits is a single store to PINx and
+ * never disables interrupts. gpio_set_level() and gpio_set_direction() use
+ * the same atomic update.
+ */
+int16_t gpio_write_mask(gpio_register_t reg, uint8_t mask, uint8_t value);
+int16_t gpio_set_mask(gpio_register_t reg, uint8_t mask);
+int16_t gpio_clear_mask(gpio_register_t reg, uint8_t mask);
+int16_t gpio_toggle_mask(gpio_register_t reg, uint8_t mask);
+
 #endif // _GPIO_H_
@@ -0,0 +1,237 @@
+#ifndef _HOST_LUFA_USB_H_
+#define _HOST_LUFA_USB_H_
+
+// The parts of the LUFA device and CDC class API used by usb.c. host.c
+// implements the endpoints on a pseudo-terminal.
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+#define ARCH_AVR8 0
+#define ARCH_XMEGA 1
+#include "LUFAConfig.h"
+
+#define ATTR_WARN_UNUSED_RESULT __attribute__((warn_unused_result))
+#define ATTR_NON_NULL_PTR_ARG(...) __attribute__((nonnull(__VA_ARGS__)))
+
+#define GlobalInterruptEnable() host_interrupts_enable()
+#define GlobalInterruptDisable()
+
+#define VERSION_BCD(major, minor, revision)                                    \
+  (((major) << 8) | ((minor) << 4) | (revision))
+#define USB_CONFIG_POWER_MA(ma) ((ma) >> 1)
+#define USB_STRING_LEN(chars) (sizeof(USB_Descriptor_Header_t) + ((chars) << 1))
+#define USB_STRING_DESCRIPTOR(string)                                          \
+  {                                                                            \
+    .Header = {.Size = USB_STRING_LEN(sizeof(string) / sizeof(wchar_t) - 1),   \
+               .Type = DTYPE_String},                                          \
+    .UnicodeString = string                                                    \
+  }
+#define USB_STRING_DESCRIPTOR_ARRAY(...)                                       \
+  {                                                                            \
+    .Header = {.Size = sizeof(USB_Descriptor_Header_t) +                       \
+                       sizeof((uint16_t[]){__VA_ARGS__}),                      \
+               .Type = DTYPE_String},                                          \
+    .UnicodeString = {__VA_ARGS__}                                             \
+  }
+
+#define NO_DESCRIPTOR 0
+#define USE_INTERNAL_SERIAL 0xDC
+#define LANGUAGE_ID_ENG 0x0409
+
+#define ENDPOINT_DIR_IN 0x80
+#define ENDPOINT_DIR_OUT 0x00
+#define ENDPOINT_EPNUM_MASK 0x0F
+#define ENDPOINT_CONTROLEP 0
+#define EP_TYPE_CONTROL 0x00
+#define EP_TYPE_ISOCHRONOUS 0x01
+#define EP_TYPE_BULK 0x02
+#define EP_TYPE_INTERRUPT 0x03
+#define ENDPOINT_ATTR_NO_SYNC 0x00
+#define ENDPOINT_USAGE_DATA 0x00
+
+#define USB_CONFIG_ATTR_RESERVED 0x80
+#define USB_CONFIG_ATTR_SELFPOWERED 0x40
+
+#define CDC_CONTROL_LINE_OUT_DTR 0x01
+#define CDC_CONTROL_LINE_OUT_RTS 0x02
+
+enum USB_DescriptorTypes_t {
+  DTYPE_Device = 0x01,
+  DTYPE_Configuration = 0x02,
+  DTYPE_String = 0x03,
+  DTYPE_Interface = 0x04,
+  DTYPE_Endpoint = 0x05,
+};
+
+enum Endpoint_WaitUntilReady_ErrorCodes_t {
+  ENDPOINT_READYWAIT_NoError = 0,
+  ENDPOINT_READYWAIT_DeviceDisconnected = 2,
+};
+
+enum USB_Device_States_t {
+  DEVICE_STATE_Unattached = 0,
+  DEVICE_STATE_Powered = 1,
+  DEVICE_STATE_Default = 2,
+  DEVICE_STATE_Addressed = 3,
+  DEVICE_STATE_Configured = 4,
+  DEVICE_STATE_Suspended = 5,
+};
+
+enum CDC_Descriptor_ClassSubclassProtocol_t {
+  CDC_CSCP_CDCClass = 0x02,
+  CDC_CSCP_NoSpecificSubclass = 0x00,
+  CDC_CSCP_ACMSubclass = 0x02,
+  CDC_CSCP_ATCommandProtocol = 0x01,
+  CDC_CSCP_NoSpecificProtocol = 0x00,
+  CDC_CSCP_VendorSpecificProtocol = 0xFF,
+  CDC_CSCP_CDCDataClass = 0x0A,
+  CDC_CSCP_NoDataSubclass = 0x00,
+  CDC_CSCP_NoDataProtocol = 0x00,
+};
+
+enum CDC_DescriptorTypes_t {
+  CDC_DTYPE_CSInterface = 0x24,
+  CDC_DTYPE_CSEndpoint = 0x25,
+};
+
+enum CDC_DescriptorSubtypes_t {
+  CDC_DSUBTYPE_CSInterface_Header = 0x00,
+  CDC_DSUBTYPE_CSInterface_ACM = 0x02,
+  CDC_DSUBTYPE_CSInterface_Union = 0x06,
+};
+
+typedef struct {
+  uint8_t Size;
+  uint8_t Type;
+} USB_Descriptor_Header_t;
+
+typedef struct {
+  USB_Descriptor_Header_t Header;
+  uint16_t USBSpecification;
+  uint8_t Class;
+  uint8_t SubClass;
+  uint8_t Protocol;
+  uint8_t Endpoint0Size;
+  uint16_t VendorID;
+  uint16_t ProductID;
+  uint16_t ReleaseNumber;
+  uint8_t ManufacturerStrIndex;
+  uint8_t ProductStrIndex;
+  uint8_t SerialNumStrIndex;
+  uint8_t NumberOfConfigurations;
+} USB_Descriptor_Device_t;
+
+typedef struct {
+  USB_Descriptor_Header_t Header;
+  uint16_t TotalConfigurationSize;
+  uint8_t TotalInterfaces;
+  uint8_t ConfigurationNumber;
+  uint8_t ConfigurationStrIndex;
+  uint8_t ConfigAttributes;
+  uint8_t MaxPowerConsumption;
+} USB_Descriptor_Configuration_Header_t;
+
+typedef struct {
+  USB_Descriptor_Header_t Header;
+  uint8_t InterfaceNumber;
+  uint8_t AlternateSetting;
+  uint8_t TotalEndpoints;
+  uint8_t Class;
+  uint8_t SubClass;
+  uint8_t Protocol;
+  uint8_t InterfaceStrIndex;
+} USB_Descriptor_Interface_t;
+
+typedef struct {
+  USB_Descriptor_Header_t Header;
+  uint8_t EndpointAddress;
+  uint8_t Attributes;
+  uint16_t EndpointSize;
+  uint8_t PollingIntervalMS;
+} USB_Descriptor_Endpoint_t;
+
+typedef struct {
+  USB_Descriptor_Header_t Header;
+  wchar_t UnicodeString[];
+} USB_Descriptor_String_t;
+
+typedef struct {
+  USB_Descriptor_Header_t Header;
+  uint8_t Subtype;
+  uint16_t CDCSpecification;
+} USB_CDC_Descriptor_FunctionalHeader_t;
+
+typedef struct {
+  USB_Descriptor_Header_t Header;
+  uint8_t Subtype;
+  uint8_t Capabilities;
+} USB_CDC_Descriptor_FunctionalACM_t;
+
+typedef struct {
+  USB_Descriptor_Header_t Header;
+  uint8_t Subtype;
+  uint8_t MasterInterfaceNumber;
+  uint8_t SlaveInterfaceNumber;
+} USB_CDC_Descriptor_FunctionalUnion_t;
+
+typedef struct {
+  uint8_t Address;
+  uint16_t Size;
+  uint8_t Type;
+  uint8_t Banks;
+} USB_Endpoint_Table_t;
+
+typedef struct {
+  struct {
+    uint8_t ControlInterfaceNumber;
+    USB_Endpoint_Table_t DataINEndpoint;
+    USB_Endpoint_Table_t DataOUTEndpoint;
+    USB_Endpoint_Table_t NotificationEndpoint;
+  } Config;
+  struct {
+    struct {
+      uint16_t HostToDevice;
+      uint16_t DeviceToHost;
+    } ControlLineStates;
+  } State;
+} USB_ClassInfo_CDC_Device_t;
+
+extern volatile uint8_t USB_DeviceState;
+
+void USB_Init(void);
+void USB_Disable(void);
+void USB_Device_ProcessControlRequest(void);
+void USB_Device_EnableSOFEvents(void);
+void USB_Device_DisableSOFEvents(void);
+uint16_t USB_Device_GetFrameNumber(void);
+
+uint8_t Endpoint_GetCurrentEndpoint(void);
+void Endpoint_SelectEndpoint(uint8_t address);
+bool Endpoint_IsOUTReceived(void);
+bool Endpoint_IsINReady(void);
+uint16_t Endpoint_BytesInEndpoint(void);
+uint8_t Endpoint_Read_8(void);
+void Endpoint_Write_8(uint8_t data);
+void Endpoint_ClearOUT(void);
+void Endpoint_ClearIN(void);
+
+bool CDC_Device_ConfigureEndpoints(USB_ClassInfo_CDC_Device_t *info);
+uint8_t CDC_Device_SendByte(USB_ClassInfo_CDC_Device_t *info, uint8_t data);
+uint8_t CDC_Device_Flush(USB_ClassInfo_CDC_Device_t *info);
+void CDC_Device_ProcessControlRequest(USB_ClassInfo_CDC_Device_t *info);
+
+// implemented by usb.c
+void EVENT_USB_Device_Connect(void);
+void EVENT_USB_Device_Disconnect(void);
+void EVENT_USB_Device_Reset(void);
+void EVENT_USB_Device_ConfigurationChanged(void);
+void EVENT_USB_Device_StartOfFrame(void);
+void EVENT_USB_Device_ControlRequest(void);
+
+#endif // _HOST_LUFA_USB_H_
@@ -0,0 +1 @@
+#include <LUFA/Drivers/USB/USB.h>
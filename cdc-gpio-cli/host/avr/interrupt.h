@@ -0,0 +1,12 @@
+#ifndef _HOST_AVR_INTERRUPT_H_
+#define _HOST_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+// Handlers become plain functions, host.c calls the timer and USB ones.
+#define ISR(vector, ...) void vector(void)
+
+#define sei() host_interrupts_enable()
+#define cli()
+
+#endif // _HOST_AVR_INTERRUPT_H_
@@ -0,0 +1,116 @@
+#ifndef _HOST_AVR_IO_H_
+#define _HOST_AVR_IO_H_
+
+#include "host.h"
+
+#define _BV(bit) (1 << (bit))
+
+#define PINB HOST_REG8(0x23)
+#define DDRB HOST_REG8(0x24)
+#define PORTB HOST_REG8(0x25)
+#define PINC HOST_REG8(0x26)
+#define DDRC HOST_REG8(0x27)
+#define PORTC HOST_REG8(0x28)
+#define PIND HOST_REG8(0x29)
+#define DDRD HOST_REG8(0x2A)
+#define PORTD HOST_REG8(0x2B)
+#define PINE HOST_REG8(0x2C)
+#define DDRE HOST_REG8(0x2D)
+#define PORTE HOST_REG8(0x2E)
+#define PINF HOST_REG8(0x2F)
+#define DDRF HOST_REG8(0x30)
+#define PORTF HOST_REG8(0x31)
+#define TIFR0 HOST_REG8(0x35)
+#define TIFR1 HOST_REG8(0x36)
+#define TIFR3 HOST_REG8(0x38)
+#define PCIFR HOST_REG8(0x3B)
+#define EIFR HOST_REG8(0x3C)
+#define EIMSK HOST_REG8(0x3D)
+#define TCCR0A HOST_REG8(0x44)
+#define TCCR0B HOST_REG8(0x45)
+#define TCNT0 HOST_REG8(0x46)
+#define SMCR HOST_REG8(0x53)
+#define MCUSR HOST_REG8(0x54)
+#define MCUCR HOST_REG8(0x55)
+#define CLKPR HOST_REG8(0x61)
+#define PCICR HOST_REG8(0x68)
+#define EICRA HOST_REG8(0x69)
+#define EICRB HOST_REG8(0x6A)
+#define PCMSK0 HOST_REG8(0x6B)
+#define TIMSK0 HOST_REG8(0x6E)
+#define TIMSK1 HOST_REG8(0x6F)
+#define TIMSK3 HOST_REG8(0x71)
+#define TCCR1A HOST_REG8(0x80)
+#define TCCR1B HOST_REG8(0x81)
+#define TCNT1 HOST_REG16(0x84)
+#define OCR1A HOST_REG16(0x88)
+#define TCCR3A HOST_REG8(0x90)
+#define TCCR3B HOST_REG8(0x91)
+#define TCNT3 HOST_REG16(0x94)
+#define OCR3A HOST_REG16(0x98)
+// UEIENX is one register for the selected endpoint on the device, here it is
+// shared, which works as usb.c enables a different bit on each endpoint
+#define UEIENX HOST_REG8(0xF0)
+#define UEINT HOST_REG8(0xF4)
+
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PC6 6
+#define PC7 7
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+#define PE2 2
+#define PE6 6
+#define PF0 0
+#define PF1 1
+#define PF4 4
+#define PF5 5
+#define PF6 6
+#define PF7 7
+
+#define PUD 4
+#define IVSEL 1
+#define IVCE 0
+#define WDRF 3
+#define TOV0 0
+#define TOV1 0
+#define TOV3 0
+#define TOIE0 0
+#define OCF1A 1
+#define OCF3A 1
+#define OCIE1A 1
+#define OCIE3A 1
+#define CS00 0
+#define CS01 1
+#define CS02 2
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define WGM32 3
+#define PCIE0 0
+#define PCIF0 0
+#define INT0 0
+#define INT1 1
+#define INT2 2
+#define INT3 3
+#define INT6 6
+#define INTF6 6
+#define ISC60 4
+#define TXINE 0
+#define RXOUTE 2
+#define RXSTPE 3
+
+#endif // _HOST_AVR_IO_H_
@@ -0,0 +1,7 @@
+#ifndef _HOST_AVR_POWER_H_
+#define _HOST_AVR_POWER_H_
+
+#define clock_div_1 0
+#define clock_prescale_set(division) ((void)(division))
+
+#endif // _HOST_AVR_POWER_H_
@@ -0,0 +1,14 @@
+#ifndef _HOST_AVR_SLEEP_H_
+#define _HOST_AVR_SLEEP_H_
+
+#include "host.h"
+
+// Sleeping waits for the pty or the next millisecond of interrupts.
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_PWR_DOWN 2
+#define set_sleep_mode(mode) ((void)(mode))
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu() host_sleep()
+
+#endif // _HOST_AVR_SLEEP_H_
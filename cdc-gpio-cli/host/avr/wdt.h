@@ -0,0 +1,12 @@
+#ifndef _HOST_AVR_WDT_H_
+#define _HOST_AVR_WDT_H_
+
+#include "host.h"
+
+#define WDTO_15MS 0
+
+// A watchdog reset ends the process.
+#define wdt_enable(timeout) host_reboot()
+#define wdt_disable()
+
+#endif // _HOST_AVR_WDT_H_
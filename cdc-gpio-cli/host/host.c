@@ -0,0 +1,393 @@
+/*
+ * Linux build of the gpio CLI. The firmware sources are compiled unchanged
+ * against the mock headers next to this file: the I/O registers are a plain
+ * byte array, and the LUFA calls used by usb.c are implemented here on a
+ * pseudo-terminal, one read() or write() per endpoint bank.
+ *
+ * A thread stands in for the interrupts. Once per millisecond it runs the
+ * USB endpoint handler for the data endpoints whose interrupt is on and
+ * ready, the start of frame handler while it is enabled, and the timer 1 and
+ * timer 3 compare handlers, all under the lock ATOMIC_BLOCK takes. The register file is plain memory, so
+ * writing PINx doesn't toggle PORTx and no pin change interrupt ever fires.
+ *
+ *   cdc-gpio-cli          serve the CLI, the pty to open is printed first
+ *   cdc-gpio-cli -b [n]   run every benchmark line n times (default 20000)
+ *                         and print commands per second and CPU time per
+ *                         command, with USB output drained and discarded
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <LUFA/Drivers/USB/USB.h>
+#include <util/atomic.h>
+
+#include "command.h"
+#include "timebase.h"
+#include "usb.h"
+
+#define HOST_BENCH_ITERATIONS 20000
+
+int firmware_main(void);
+void USB_COM_vect(void);
+void TIMER1_COMPA_vect(void);
+void TIMER3_COMPA_vect(void);
+
+volatile uint8_t host_io[HOST_IO_SIZE];
+volatile uint8_t USB_DeviceState;
+
+static pthread_mutex_t lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static pthread_t interrupts;
+static uint8_t interrupts_enabled;
+static uint8_t sof_enabled;
+
+static struct timespec epoch;
+
+static int pty = -1;
+static uint8_t bench;
+static uint64_t in_bytes;
+
+static uint8_t endpoint;
+static uint8_t out_bank[CDC_TXRX_EPSIZE];
+static uint8_t out_length;
+static uint8_t out_position;
+static uint8_t in_bank[CDC_TXRX_EPSIZE];
+static uint8_t in_length;
+
+static bool out_fill(void);
+
+// The command lines of the benchmark, from the cheapest path up.
+static const char *const bench_lines[] = {
+    "version",
+    "gpio PB5",
+    "gpio PB5 1",
+    "gpio PINB",
+    "gpio PORTB set 32",
+    "gpio PB0,PB1,PB2 out",
+    "batch PB5=1 PB5=0 PINB",
+    "gpio PB0 out;gpio PB1 out;gpio PB2 out;gpio PB3 out",
+    "usb stats",
+    "gpio all",
+    "help",
+};
+
+static uint64_t elapsed_ns(clockid_t clock, const struct timespec *since) {
+  struct timespec now;
+
+  clock_gettime(clock, &now);
+  return (uint64_t)(now.tv_sec - since->tv_sec) * 1000000000ULL +
+         (uint64_t)now.tv_nsec - (uint64_t)since->tv_nsec;
+}
+
+/* interrupts */
+
+uint8_t host_atomic_enter(void) {
+  pthread_mutex_lock(&lock);
+  return 1;
+}
+
+void host_atomic_exit(const uint8_t *state) {
+  (void)state;
+  pthread_mutex_unlock(&lock);
+}
+
+// Runs everything one millisecond of interrupts would. The overflow flag of
+// timer 1 is set without the lock, as capture_triggered() polls it with
+// interrupts off.
+static void run_interrupts(void) {
+  if (TCCR1B & 0x07) {
+    TIFR1 |= _BV(TOV1);
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    // the IN bank is always free, an OUT packet is there when the pty has
+    // data
+    UEINT = 0;
+    if ((UEIENX & _BV(RXOUTE)) && out_fill()) {
+      UEINT |= _BV(CDC_RX_EPADDR & ENDPOINT_EPNUM_MASK);
+    }
+    if (UEIENX & _BV(TXINE)) {
+      UEINT |= _BV(CDC_TX_EPADDR & ENDPOINT_EPNUM_MASK);
+    }
+    if (UEINT) {
+      USB_COM_vect();
+    }
+
+    if (sof_enabled) {
+      EVENT_USB_Device_StartOfFrame();
+    }
+
+    if ((TCCR1B & 0x07) && (TIMSK1 & _BV(OCIE1A))) {
+      TIMER1_COMPA_vect();
+    }
+    if ((TCCR3B & 0x07) && (TIMSK3 & _BV(OCIE3A))) {
+      TIMER3_COMPA_vect();
+    }
+  }
+}
+
+static void *interrupt_thread(void *arg) {
+  struct timespec tick = {0, 1000000};
+
+  (void)arg;
+  for (;;) {
+    nanosleep(&tick, NULL);
+    run_interrupts();
+  }
+  return NULL;
+}
+
+void host_interrupts_enable(void) {
+  if (!interrupts_enabled && !bench) {
+    interrupts_enabled = 1;
+    pthread_create(&interrupts, NULL, interrupt_thread, NULL);
+  }
+}
+
+void host_reboot(void) {
+  fprintf(stderr, "reboot\n");
+  exit(0);
+}
+
+/* timebase, from the host clock instead of timer 0 */
+
+void timebase_init(void) { clock_gettime(CLOCK_MONOTONIC, &epoch); }
+
+void timebase_stop(void) {}
+
+uint32_t timebase_micros(void) {
+  return elapsed_ns(CLOCK_MONOTONIC, &epoch) / 1000;
+}
+
+uint16_t timebase_read_cost(void) {
+  struct timespec start;
+  uint64_t ns;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (uint16_t i = 0; i < 1024; i++) {
+    timebase_micros();
+  }
+  ns = elapsed_ns(CLOCK_MONOTONIC, &start);
+
+  // in cycles of the real clock, for comparison with the device
+  return ns * (F_CPU / 1000000UL) / 1000 / 1024;
+}
+
+/* LUFA */
+
+void USB_Init(void) {
+  USB_DeviceState = DEVICE_STATE_Configured;
+  EVENT_USB_Device_Reset();
+  EVENT_USB_Device_ConfigurationChanged();
+}
+
+void USB_Disable(void) {
+  fprintf(stderr, "USB detached\n");
+  exit(0);
+}
+
+// The firmware sleeps when it has nothing to do, give the CPU away until data
+// arrives or the interrupt thread has run again.
+void host_sleep(void) {
+  if (!bench && pty >= 0 && out_length == 0) {
+    struct pollfd fd = {.fd = pty, .events = POLLIN};
+
+    poll(&fd, 1, 1);
+  }
+}
+
+// Only called for a SETUP packet, which the pty never has.
+void USB_Device_ProcessControlRequest(void) {}
+
+void USB_Device_EnableSOFEvents(void) { sof_enabled = 1; }
+
+void USB_Device_DisableSOFEvents(void) { sof_enabled = 0; }
+
+// Waiting loops in usb.c watch the frame number. In benchmark mode there is
+// no interrupt thread, so every look at it drains the TX ring at once.
+uint16_t USB_Device_GetFrameNumber(void) {
+  if (bench) {
+    run_interrupts();
+  }
+  return (elapsed_ns(CLOCK_MONOTONIC, &epoch) / 1000000) & 0x07FF;
+}
+
+uint8_t Endpoint_GetCurrentEndpoint(void) { return endpoint; }
+
+void Endpoint_SelectEndpoint(uint8_t address) { endpoint = address; }
+
+// Reads the next packet from the pty once the last one is used up.
+static bool out_fill(void) {
+  if (pty < 0) {
+    return false;
+  }
+
+  if (out_length == 0) {
+    ssize_t length = read(pty, out_bank, sizeof(out_bank));
+
+    if (length > 0) {
+      out_length = length;
+      out_position = 0;
+    }
+  }
+  return out_length > 0;
+}
+
+bool Endpoint_IsOUTReceived(void) {
+  return endpoint == CDC_RX_EPADDR && out_fill();
+}
+
+bool Endpoint_IsINReady(void) { return endpoint == CDC_TX_EPADDR; }
+
+uint16_t Endpoint_BytesInEndpoint(void) {
+  return (endpoint == CDC_RX_EPADDR) ? out_length - out_position : in_length;
+}
+
+uint8_t Endpoint_Read_8(void) {
+  return (out_position < out_length) ? out_bank[out_position++] : 0;
+}
+
+void Endpoint_Write_8(uint8_t data) {
+  if (in_length < sizeof(in_bank)) {
+    in_bank[in_length++] = data;
+  }
+}
+
+void Endpoint_ClearOUT(void) { out_length = 0; }
+
+// Sends the bank to the pty. Nobody reading it is like no host reading the
+// port: the data is dropped, and usb_send() times out.
+void Endpoint_ClearIN(void) {
+  in_bytes += in_length;
+  if (!bench && pty >= 0 && in_length > 0) {
+    if (write(pty, in_bank, in_length) < 0 && errno != EAGAIN) {
+      perror("write");
+    }
+  }
+  in_length = 0;
+}
+
+bool CDC_Device_ConfigureEndpoints(USB_ClassInfo_CDC_Device_t *info) {
+  (void)info;
+  return true;
+}
+
+// The class driver's per-byte path, on the same IN bank as usb.c. A full
+// bank waits for the next frame, as Endpoint_WaitUntilReady() waits for the
+// host to take it.
+uint8_t CDC_Device_SendByte(USB_ClassInfo_CDC_Device_t *info, uint8_t data) {
+  (void)info;
+  Endpoint_SelectEndpoint(CDC_TX_EPADDR);
+  if (in_length == sizeof(in_bank)) {
+    uint16_t frame = USB_Device_GetFrameNumber();
+
+    Endpoint_ClearIN();
+    while (USB_Device_GetFrameNumber() == frame) {
+    }
+  }
+  Endpoint_Write_8(data);
+  return ENDPOINT_READYWAIT_NoError;
+}
+
+uint8_t CDC_Device_Flush(USB_ClassInfo_CDC_Device_t *info) {
+  (void)info;
+  Endpoint_SelectEndpoint(CDC_TX_EPADDR);
+  Endpoint_ClearIN();
+  return ENDPOINT_READYWAIT_NoError;
+}
+
+void CDC_Device_ProcessControlRequest(USB_ClassInfo_CDC_Device_t *info) {
+  (void)info;
+}
+
+/* pty and benchmark */
+
+// Keeps the slave side open in raw mode, so the pty survives terminals
+// coming and going and passes bytes through untouched.
+static int open_pty(void) {
+  struct termios termios;
+  int slave;
+
+  pty = posix_openpt(O_RDWR | O_NOCTTY);
+  if (pty < 0 || grantpt(pty) < 0 || unlockpt(pty) < 0) {
+    perror("pty");
+    return -1;
+  }
+
+  slave = open(ptsname(pty), O_RDWR | O_NOCTTY);
+  if (slave < 0 || tcgetattr(slave, &termios) < 0) {
+    perror(ptsname(pty));
+    return -1;
+  }
+  cfmakeraw(&termios);
+  tcsetattr(slave, TCSANOW, &termios);
+
+  fcntl(pty, F_SETFL, fcntl(pty, F_GETFL) | O_NONBLOCK);
+  printf("%s\n", ptsname(pty));
+  fflush(stdout);
+  return 0;
+}
+
+static int bench_write(const char *s, size_t len) {
+  return usb_send(s, len) ? -1 : (int)len;
+}
+
+static void run_bench(unsigned iterations) {
+  mcucli_t cli;
+
+  timebase_init();
+  usb_init();
+  command_init(&cli, bench_write);
+
+  printf("%-52s %10s %12s %10s\n", "command", "cmds/s", "cpu ns/cmd",
+         "bytes/cmd");
+
+  for (size_t i = 0; i < sizeof(bench_lines) / sizeof(bench_lines[0]); i++) {
+    const char *line = bench_lines[i];
+    struct timespec wall;
+    struct timespec cpu;
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    uint64_t bytes = in_bytes;
+
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+
+    for (unsigned n = 0; n < iterations; n++) {
+      for (const char *c = line; *c != '\0'; c++) {
+        command_putc(&cli, *c);
+      }
+      command_putc(&cli, '\r');
+      run_interrupts();
+    }
+
+    wall_ns = elapsed_ns(CLOCK_MONOTONIC, &wall);
+    cpu_ns = elapsed_ns(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+
+    printf("%-52s %10.0f %12.1f %10.1f\n", line,
+           iterations * 1e9 / (double)wall_ns, cpu_ns / (double)iterations,
+           (in_bytes - bytes) / (double)iterations);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc >= 2 && strcmp(argv[1], "-b") == 0) {
+    bench = 1;
+    run_bench((argc >= 3) ? strtoul(argv[2], NULL, 0) : HOST_BENCH_ITERATIONS);
+    return 0;
+  }
+
+  if (open_pty() < 0) {
+    return 1;
+  }
+  return firmware_main();
+}
@@ -0,0 +1,21 @@
+#ifndef _HOST_H_
+#define _HOST_H_
+
+#include <stdint.h>
+
+// The mock register file, indexed by the data space address of a register.
+#define HOST_IO_SIZE 0x100
+extern volatile uint8_t host_io[HOST_IO_SIZE];
+
+#define HOST_REG8(address) (host_io[address])
+#define HOST_REG16(address) (*(volatile uint16_t *)&host_io[address])
+
+// ATOMIC_BLOCK and the emulated interrupts share one recursive lock.
+uint8_t host_atomic_enter(void);
+void host_atomic_exit(const uint8_t *state);
+
+void host_interrupts_enable(void);
+void host_sleep(void);
+void host_reboot(void) __attribute__((noreturn));
+
+#endif // _HOST_H_
@@ -0,0 +1,15 @@
+#ifndef _HOST_UTIL_ATOMIC_H_
+#define _HOST_UTIL_ATOMIC_H_
+
+#include "host.h"
+
+// Like avr-libc, the lock is released by a cleanup handler, so leaving the
+// block with return or break is fine.
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 1
+#define ATOMIC_BLOCK(type)                                                     \
+  for (uint8_t host_atomic __attribute__((cleanup(host_atomic_exit))) =        \
+           host_atomic_enter();                                                \
+       host_atomic; host_atomic = 0)
+
+#endif // _HOST_UTIL_ATOMIC_H_
@@ -0,0 +1,87 @@
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+
+#include "capture.h"
+#include "events.h"
+#include "idle.h"
+#include "pattern.h"
+#include "timebase.h"
+#include "usb.h"
+
+// Timer 0 runs at F_CPU / 8 for the timebase.
+#define IDLE_CYCLES_PER_TICK 8
+
+static idle_stats_t stats;
+static uint32_t reset_time;
+
+void idle_init(void) { idle_reset_stats(); }
+
+// Power-down stops every clock but the watchdog, only while the bus is
+// suspended and no timer driven capture or pattern would be cut short.
+static uint8_t can_power_down(void) {
+  return usb_suspended() && !pattern_running() &&
+         capture_get_state() != CAPTURE_RUNNING;
+}
+
+/** Sleeps until the next interrupt if the main loop has nothing to do, i.e.
+ * no received byte and no pin event is waiting. Everything else the loop
+ * reacts to is changed by an interrupt, which ends the sleep: the USB
+ * endpoint interrupt for every packet, the timebase overflow every
+ * TIMEBASE_OVERFLOW_US, and the capture, pattern and pin handlers.
+ *
+ * The check and the sleep happen with interrupts off up to the sleep
+ * instruction itself, which always runs before a handler pending from the
+ * sei() in front of it, so no wake-up is ever missed.
+ */
+void idle_sleep(void) {
+  uint32_t start;
+  uint32_t end;
+  uint8_t count;
+  uint8_t power_down;
+
+  cli();
+  if (usb_available() > 0 || events_pending()) {
+    sei();
+    return;
+  }
+
+  power_down = can_power_down();
+  set_sleep_mode(power_down ? SLEEP_MODE_PWR_DOWN : SLEEP_MODE_IDLE);
+  start = timebase_micros();
+
+  sleep_enable();
+  sei();
+  sleep_cpu();
+  sleep_disable();
+
+  // the timer counts from its overflow, so right after a wake-up by it the
+  // count is the time the handler and the return took
+  count = TCNT0;
+  end = timebase_micros();
+
+  stats.sleeps++;
+  if (power_down) {
+    // timer 0 stands still in power-down, the time asleep is unknown
+    stats.suspends++;
+  } else {
+    stats.idle += end - start;
+    if (start / TIMEBASE_OVERFLOW_US != end / TIMEBASE_OVERFLOW_US) {
+      stats.wake_last = count * IDLE_CYCLES_PER_TICK;
+      if (stats.wake_last > stats.wake_max) {
+        stats.wake_max = stats.wake_last;
+      }
+    }
+  }
+}
+
+// The statistics are only touched by the main loop, no locking needed.
+void idle_get_stats(idle_stats_t *result) {
+  *result = stats;
+  result->elapsed = timebase_micros() - reset_time;
+}
+
+void idle_reset_stats(void) {
+  stats = (idle_stats_t){0};
+  reset_time = timebase_micros();
+}
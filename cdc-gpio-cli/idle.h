@@ -0,0 +1,20 @@
+#ifndef _IDLE_H_
+#define _IDLE_H_
+
+#include <stdint.h>
+
+typedef struct {
+  uint32_t elapsed;   // microseconds since the last reset
+  uint32_t idle;      // microseconds of that spent in idle sleep
+  uint32_t sleeps;    // times the main loop went to sleep
+  uint16_t suspends;  // power-down sleeps while the bus was suspended
+  uint16_t wake_last; // cycles from the last timer 0 wake-up to the main loop
+  uint16_t wake_max;  // the worst of them since the last reset
+} idle_stats_t;
+
+void idle_init(void);
+void idle_sleep(void);
+void idle_get_stats(idle_stats_t *stats);
+void idle_reset_stats(void);
+
+#endif // _IDLE_H_
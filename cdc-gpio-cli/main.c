@@ -5,14 +5,18 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "binary.h"
 #include "command.h"
+#include "events.h"
+#include "idle.h"
+#include "pattern.h"
+#include "sump.h"
+#include "timebase.h"
 #include "usb.h"
 
 static int usb_puts(const char *s, size_t len) {
-  for (size_t i = 0; i < len; i++) {
-    if (usb_write_byte(s[i]) != 0) {
-      return -1;
-    }
+  if (usb_send(s, len) != 0) {
+    return -1;
   }
   return len;
 }
@@ -23,25 +27,58 @@ static void hardware_init(void) {
   MCUSR &= ~(1 << WDRF);
   wdt_disable();
 
+  // run at full speed whatever the CKDIV8 fuse says
+  clock_prescale_set(clock_div_1);
+
+  // start the microsecond timebase
+  timebase_init();
+
   // init lufa usb CDC device
   usb_init();
 }
 
 // The entry point for the application code
 int main(void) {
-  uint16_t value;
+  int16_t value;
+  uint8_t binary_mode = 0;
+  uint8_t reply;
   mcucli_t usb_cli;
 
   hardware_init();
 
   command_init(&usb_cli, usb_puts);
+  binary_init();
+  events_init();
+  idle_init();
 
   GlobalInterruptEnable();
 
   for (;;) {
-    if ((value = usb_read_byte()) != -1) {
-      mcucli_putc(&usb_cli, value);
+    // the replies to everything handled below leave in as few packets as
+    // they fit, when the hold ends
+    usb_tx_hold();
+    reply = 0;
+
+    // drain everything the USB interrupt has received so far
+    while ((value = usb_read_byte()) >= 0) {
+      if (pattern_loading()) {
+        pattern_putc(value);
+      } else if (sump_active()) {
+        sump_putc(value);
+      } else if (binary_mode) {
+        binary_mode = binary_putc(value);
+      } else if (value == BINARY_ESCAPE) {
+        binary_mode = 1;
+      } else {
+        reply |= command_putc(&usb_cli, value);
+      }
+    }
+    if (!binary_mode && !sump_active()) {
+      command_task();
     }
-    usb_task();
+    usb_tx_release(reply);
+
+    sump_task();
+    idle_sleep();
   }
 }
@@ -0,0 +1,42 @@
+#include <avr/pgmspace.h>
+
+#include "gpio.h"
+#include "names.h"
+#include "names_table.h"
+
+#define NAMES_EMPTY_SLOT 0xFF
+
+// The entries keep the order of names.spec, and the slot table maps the
+// perfect hash of each name to its entry, so a lookup hashes the name once and
+// compares it against at most one entry.
+static const name_entry_t names[] PROGMEM = {NAMES_ENTRIES};
+static const uint8_t slots[NAMES_SLOT_COUNT] PROGMEM = {NAMES_SLOTS};
+
+static uint8_t name_hash(const char *name) {
+  uint8_t hash = NAMES_HASH_SEED;
+
+  while (*name != '\0') {
+    hash = hash * NAMES_HASH_MULTIPLIER + (uint8_t)*name++;
+  }
+  return hash & (NAMES_SLOT_COUNT - 1);
+}
+
+/** Resolves an upper case register or pin name. Returns 1 and copies the
+ * entry from flash if the name is known, 0 otherwise.
+ */
+uint8_t name_lookup(const char *name, name_entry_t *entry) {
+  uint8_t index = pgm_read_byte(&slots[name_hash(name)]);
+
+  if (index == NAMES_EMPTY_SLOT || strcmp_P(name, names[index].str) != 0) {
+    return 0;
+  }
+
+  memcpy_P(entry, &names[index], sizeof(name_entry_t));
+  return 1;
+}
+
+uint8_t name_count(void) { return NAMES_COUNT; }
+
+void name_get(uint8_t index, name_entry_t *entry) {
+  memcpy_P(entry, &names[index], sizeof(name_entry_t));
+}
@@ -0,0 +1,24 @@
+#ifndef _NAMES_H_
+#define _NAMES_H_
+
+#include <stdint.h>
+
+// the longest register or pin name, including the terminating zero
+#define NAME_SIZE 6
+
+typedef enum {
+  NAME_REGISTER,
+  NAME_PIN,
+} name_kind_t;
+
+typedef struct {
+  char str[NAME_SIZE];
+  uint8_t kind;
+  uint8_t id; // a gpio_register_t or gpio_pin_t, depending on kind
+} name_entry_t;
+
+uint8_t name_lookup(const char *name, name_entry_t *entry);
+uint8_t name_count(void);
+void name_get(uint8_t index, name_entry_t *entry);
+
+#endif // _NAMES_H_
@@ -0,0 +1,67 @@
+# Commands and names understood by the CLI. gen-names.py turns this file into
+# names_table.h at build time, so new entries only need to be added here.
+#
+#   command <name> <handler> <help>
+#   register <name> <gpio_register_t>
+#   pin <name> <gpio_pin_t>
+#
+# Commands are listed in help order. Registers and pins go into one perfect
+# hashed flash table, and `gpio all` prints the registers in the order below.
+
+command help process_help help_help
+command ? process_help help_help
+command gpio process_gpio help_gpio
+command version process_version help_version
+command time process_time help_time
+command idle process_idle help_idle
+command reboot process_reboot help_reboot
+command bootloader process_bootloader help_bootloader
+command usb process_usb help_usb
+command batch process_batch help_batch
+command capture process_capture help_capture
+command pattern process_pattern help_pattern
+command event process_event help_event
+
+register MCUCR GPIO_MCUCR
+register DDRB GPIO_DDRB
+register DDRC GPIO_DDRC
+register DDRD GPIO_DDRD
+register DDRE GPIO_DDRE
+register DDRF GPIO_DDRF
+register PORTB GPIO_PORTB
+register PORTC GPIO_PORTC
+register PORTD GPIO_PORTD
+register PORTE GPIO_PORTE
+register PORTF GPIO_PORTF
+register PINB GPIO_PINB
+register PINC GPIO_PINC
+register PIND GPIO_PIND
+register PINE GPIO_PINE
+register PINF GPIO_PINF
+
+pin PB0 GPIO_PB0
+pin PB1 GPIO_PB1
+pin PB2 GPIO_PB2
+pin PB3 GPIO_PB3
+pin PB4 GPIO_PB4
+pin PB5 GPIO_PB5
+pin PB6 GPIO_PB6
+pin PB7 GPIO_PB7
+pin PC6 GPIO_PC6
+pin PC7 GPIO_PC7
+pin PD0 GPIO_PD0
+pin PD1 GPIO_PD1
+pin PD2 GPIO_PD2
+pin PD3 GPIO_PD3
+pin PD4 GPIO_PD4
+pin PD5 GPIO_PD5
+pin PD6 GPIO_PD6
+pin PD7 GPIO_PD7
+pin PE2 GPIO_PE2
+pin PE6 GPIO_PE6
+pin PF0 GPIO_PF0
+pin PF1 GPIO_PF1
+pin PF4 GPIO_PF4
+pin PF5 GPIO_PF5
+pin PF6 GPIO_PF6
+pin PF7 GPIO_PF7
@@ -0,0 +1,278 @@
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <stddef.h>
+#include <util/atomic.h>
+
+#include "pattern.h"
+
+#if PATTERN_BUFFER_SIZE > 256
+#error "pattern_replay() compares only the low byte of the step address"
+#endif
+
+typedef struct {
+  volatile uint8_t *ports[PATTERN_MAX_PORTS];
+  uint8_t writable[PATTERN_MAX_PORTS]; // gpio_write() bits of each port
+  uint8_t num_ports;
+  uint8_t holds;     // every step ends with a hold count
+  uint8_t step_size; // bytes per step
+  uint8_t column;    // byte of the step the next uploaded byte goes to
+  uint16_t fill;     // bytes uploaded so far
+  uint16_t loading;  // raw bytes pattern_putc() still expects
+  uint16_t length;   // bytes the interrupt replays, whole steps only
+  uint16_t index;    // next step the interrupt writes
+  uint8_t hold;      // timer periods left for the current step
+  uint16_t remaining; // passes left, 0 repeats forever
+  volatile uint8_t running;
+} pattern_t;
+
+static uint8_t buffer[PATTERN_BUFFER_SIZE];
+static pattern_t pattern;
+
+static const uint16_t prescalers[] = {1, 8, 64, 256, 1024};
+
+static void timer_stop(void) {
+  TIMSK3 = 0;
+  TCCR3B = 0;
+}
+
+// Writes one step to every port on each compare match of timer 3, so the step
+// period doesn't depend on the host. A hold count of 0 holds for 256 periods.
+ISR(TIMER3_COMPA_vect) {
+  const uint8_t *step;
+
+  if (--pattern.hold != 0) {
+    return;
+  }
+
+  step = &buffer[pattern.index];
+  for (uint8_t i = 0; i < pattern.num_ports; i++) {
+    *pattern.ports[i] = step[i];
+  }
+  pattern.hold = pattern.holds ? step[pattern.num_ports] : 1;
+
+  pattern.index += pattern.step_size;
+  if (pattern.index >= pattern.length) {
+    pattern.index = 0;
+    if (pattern.remaining != 0 && --pattern.remaining == 0) {
+      timer_stop();
+      pattern.running = 0;
+    }
+  }
+}
+
+static void append(uint8_t byte) {
+  if (pattern.column < pattern.num_ports) {
+    byte &= pattern.writable[pattern.column];
+  }
+  buffer[pattern.fill++] = byte;
+
+  if (++pattern.column == pattern.step_size) {
+    pattern.column = 0;
+  }
+}
+
+/** Clears the pattern and sets the ports each step is written to, in order.
+ * With holds every step carries one more byte, the number of timer periods
+ * it lasts.
+ */
+int16_t pattern_new(const gpio_register_t *regs, uint8_t num_ports,
+                    uint8_t holds) {
+  if (pattern.running) {
+    return PATTERN_ERROR_BUSY;
+  }
+
+  if (num_ports == 0 || num_ports > PATTERN_MAX_PORTS) {
+    return PATTERN_ERROR_INVALID;
+  }
+
+  for (uint8_t i = 0; i < num_ports; i++) {
+    int16_t writable = gpio_get_writable(regs[i]);
+
+    if (writable <= 0) {
+      return PATTERN_ERROR_INVALID;
+    }
+    pattern.ports[i] = gpio_get_address(regs[i]);
+    pattern.writable[i] = writable;
+  }
+
+  pattern.num_ports = num_ports;
+  pattern.holds = holds ? 1 : 0;
+  pattern.step_size = num_ports + pattern.holds;
+  pattern.column = 0;
+  pattern.fill = 0;
+  pattern.loading = 0;
+  return PATTERN_ERROR_NONE;
+}
+
+/** Appends one step, pattern_step_size() bytes. */
+int16_t pattern_add(const uint8_t *step) {
+  if (pattern.running || pattern.loading) {
+    return PATTERN_ERROR_BUSY;
+  }
+
+  if (pattern.step_size == 0) {
+    return PATTERN_ERROR_INVALID;
+  }
+
+  if (pattern.fill + pattern.step_size > PATTERN_BUFFER_SIZE) {
+    return PATTERN_ERROR_FULL;
+  }
+
+  for (uint8_t i = 0; i < pattern.step_size; i++) {
+    append(step[i]);
+  }
+  return PATTERN_ERROR_NONE;
+}
+
+/** Makes pattern_putc() take the next length bytes of the host stream as raw
+ * steps, appended to the pattern.
+ */
+int16_t pattern_load(uint16_t length) {
+  if (pattern.running || pattern.loading) {
+    return PATTERN_ERROR_BUSY;
+  }
+
+  if (pattern.step_size == 0 || length == 0) {
+    return PATTERN_ERROR_INVALID;
+  }
+
+  if (pattern.fill + length > PATTERN_BUFFER_SIZE) {
+    return PATTERN_ERROR_FULL;
+  }
+
+  pattern.loading = length;
+  return PATTERN_ERROR_NONE;
+}
+
+uint8_t pattern_loading(void) { return pattern.loading != 0; }
+
+void pattern_putc(uint8_t byte) {
+  if (pattern.loading != 0) {
+    append(byte);
+    pattern.loading--;
+  }
+}
+
+int16_t pattern_steps(void) {
+  if (pattern.step_size == 0) {
+    return 0;
+  }
+  return pattern.fill / pattern.step_size;
+}
+
+uint8_t pattern_step_size(void) { return pattern.step_size; }
+
+/** Replays the pattern from the timer 3 interrupt at the closest step rate
+ * the timer can produce and returns that rate, or 0 if it can't run. A repeat
+ * of 0 replays it until pattern_stop().
+ */
+uint32_t pattern_start(uint32_t rate, uint16_t repeat) {
+  uint32_t period;
+  uint32_t top = 0;
+  uint8_t clock;
+
+  if (pattern.loading || pattern_steps() == 0 || rate == 0) {
+    return 0;
+  }
+
+  pattern_stop();
+
+  period = F_CPU / rate;
+  if (period < PATTERN_MIN_PERIOD) {
+    period = PATTERN_MIN_PERIOD;
+  }
+
+  for (clock = 0; clock < sizeof(prescalers) / sizeof(prescalers[0]);
+       clock++) {
+    top = period / prescalers[clock];
+    if (top <= 0x10000) {
+      break;
+    }
+  }
+
+  if (clock == sizeof(prescalers) / sizeof(prescalers[0])) {
+    return 0;
+  }
+
+  pattern.length = pattern_steps() * pattern.step_size;
+  pattern.index = 0;
+  pattern.hold = 1;
+  pattern.remaining = repeat;
+  pattern.running = 1;
+
+  TCCR3A = 0;
+  TCNT3 = 0;
+  OCR3A = top - 1;
+  TIFR3 = _BV(OCF3A);
+  TIMSK3 = _BV(OCIE3A);
+  TCCR3B = _BV(WGM32) | (clock + 1);
+
+  return F_CPU / (prescalers[clock] * top);
+}
+
+void pattern_stop(void) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    timer_stop();
+    pattern.running = 0;
+  }
+}
+
+uint8_t pattern_running(void) { return pattern.running; }
+
+// Writes steps bytes from start up to end to port, wrapping back to start,
+// in exactly PATTERN_REPLAY_CYCLES cycles each. Both ways through the rewind
+// take 2 cycles: the taken brne, or the brne falling through plus the movw.
+// Comparing the low byte of X is enough for patterns of up to 256 bytes.
+static void replay(volatile uint8_t *port, const uint8_t *start, uint8_t end,
+                   uint32_t steps) {
+  const uint8_t *data = start;
+#ifdef __AVR__
+  uint8_t byte;
+
+  __asm__ __volatile__("1: ld %[byte], X+\n\t"
+                       "st Z, %[byte]\n\t"
+                       "cp r26, %[end]\n\t"
+                       "brne 2f\n\t"
+                       "movw r26, %[start]\n\t"
+                       "2: subi %A[steps], 1\n\t"
+                       "sbci %B[steps], 0\n\t"
+                       "sbci %C[steps], 0\n\t"
+                       "brne 1b\n\t"
+                       : [byte] "=&r"(byte), [steps] "+d"(steps),
+                         [data] "+x"(data)
+                       : [end] "r"(end), [start] "r"(start), "z"(port)
+                       : "memory");
+#else
+  // host builds replay the same steps without the cycle timing
+  while (steps-- > 0) {
+    *port = *data++;
+    if ((uint8_t)(uintptr_t)data == end) {
+      data = start;
+    }
+  }
+#endif
+}
+
+/** Replays a one port pattern without holds repeat times from a cycle counted
+ * loop, one step every PATTERN_REPLAY_CYCLES cycles (1.33 MHz at 16 MHz).
+ * Interrupts, and with them USB, are off until it is done.
+ */
+int16_t pattern_replay(uint32_t repeat) {
+  uint32_t steps = (uint32_t)pattern_steps() * repeat;
+
+  if (pattern.running || pattern.loading) {
+    return PATTERN_ERROR_BUSY;
+  }
+
+  if (pattern.num_ports != 1 || pattern.holds || steps == 0 ||
+      repeat > PATTERN_REPLAY_MAX_STEPS ||
+      steps > PATTERN_REPLAY_MAX_STEPS) {
+    return PATTERN_ERROR_INVALID;
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    replay(pattern.ports[0], buffer,
+           (uint8_t)(uintptr_t)&buffer[pattern_steps()], steps);
+  }
+  return PATTERN_ERROR_NONE;
+}
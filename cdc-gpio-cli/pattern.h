@@ -0,0 +1,41 @@
+#ifndef _PATTERN_H_
+#define _PATTERN_H_
+
+#include <stdint.h>
+
+#include "gpio.h"
+
+#define PATTERN_ERROR_NONE 0
+#define PATTERN_ERROR_INVALID -1
+#define PATTERN_ERROR_FULL -2
+#define PATTERN_ERROR_BUSY -3
+
+// Step memory, each step takes one byte per port plus an optional hold byte.
+#ifndef PATTERN_BUFFER_SIZE
+#define PATTERN_BUFFER_SIZE 256
+#endif
+
+#define PATTERN_MAX_PORTS 3
+
+// The shortest step period in CPU cycles the timer interrupt can keep up with
+// when all ports are written.
+#define PATTERN_MIN_PERIOD 128
+
+// CPU cycles per step of pattern_replay(), fixed by its loop.
+#define PATTERN_REPLAY_CYCLES 12
+#define PATTERN_REPLAY_MAX_STEPS 0xFFFFFFUL
+
+int16_t pattern_new(const gpio_register_t *regs, uint8_t num_ports,
+                    uint8_t holds);
+int16_t pattern_add(const uint8_t *step);
+int16_t pattern_load(uint16_t length);
+uint8_t pattern_loading(void);
+void pattern_putc(uint8_t byte);
+int16_t pattern_steps(void);
+uint8_t pattern_step_size(void);
+uint32_t pattern_start(uint32_t rate, uint16_t repeat);
+void pattern_stop(void);
+uint8_t pattern_running(void);
+int16_t pattern_replay(uint32_t repeat);
+
+#endif // _PATTERN_H_
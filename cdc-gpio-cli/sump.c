@@ -0,0 +1,272 @@
+#include <avr/pgmspace.h>
+
+#include "capture.h"
+#include "sump.h"
+#include "usb.h"
+#include "version.h"
+
+#define SUMP_RESET 0x00
+#define SUMP_RUN 0x01
+#define SUMP_ID 0x02
+#define SUMP_METADATA 0x04
+#define SUMP_SET_DIVIDER 0x80
+#define SUMP_SET_READ_DELAY 0x81
+#define SUMP_SET_FLAGS 0x82
+#define SUMP_SET_TRIGGER_MASK 0xC0  // of stage 0
+#define SUMP_SET_TRIGGER_VALUE 0xC1
+#define SUMP_SET_TRIGGER_CONFIG 0xC2
+
+#define SUMP_LONG_COMMAND 0x80
+#define SUMP_COMMAND_SIZE 5
+
+#define SUMP_FLAGS_GROUPS_SHIFT 2
+#define SUMP_TRIGGER_START 0x08 // in the last byte of the configuration
+
+static const uint8_t sump_id[] PROGMEM = {'1', 'A', 'L', 'S'};
+
+static const char sump_name[] PROGMEM = "ATmega32U4 CDC logic analyzer";
+
+typedef struct {
+  uint8_t active;
+  uint8_t armed;    // DTR was raised while in SUMP mode
+  uint8_t last_dtr;
+  uint8_t running;
+  uint8_t groups;
+  uint32_t divider;
+  uint32_t read_count;
+  uint32_t delay_count; // samples from the trigger on
+  uint32_t trigger_mask;
+  uint32_t trigger_value;
+  uint8_t trigger_start;
+  uint32_t samples;     // what the last run took, after clamping
+  uint32_t rate;
+  uint8_t command[SUMP_COMMAND_SIZE];
+  uint8_t command_length;
+} sump_t;
+
+static sump_t sump;
+
+static void send_P(const void *data, uint8_t length) {
+  const uint8_t *bytes = data;
+
+  for (uint8_t i = 0; i < length; i++) {
+    uint8_t byte = pgm_read_byte(&bytes[i]);
+    usb_send(&byte, 1);
+  }
+}
+
+static void send_uint32(uint8_t key, uint32_t value) {
+  uint8_t bytes[] = {key, value >> 24, value >> 16, value >> 8, value};
+
+  usb_send(bytes, sizeof(bytes));
+}
+
+static uint32_t get_uint32(const uint8_t *data) {
+  return data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) |
+         ((uint32_t)data[3] << 24);
+}
+
+/** Sends the metadata. Once a run has been clamped to what the buffer holds
+ * and the timer can do, the sample memory and rate are those of that run, so
+ * the front end can see what it got instead of what it asked for.
+ */
+static void send_metadata(void) {
+  uint8_t bytes[2];
+  uint32_t memory = CAPTURE_BUFFER_SIZE;
+  uint32_t rate = capture_max_rate();
+
+  if (sump.samples > 0) {
+    memory = sump.samples * capture_sample_size(sump.groups);
+    rate = sump.rate;
+  }
+
+  bytes[0] = 0x01; // device name
+  usb_send(bytes, 1);
+  send_P(sump_name, sizeof(sump_name));
+
+  bytes[0] = 0x02; // firmware version
+  usb_send(bytes, 1);
+  send_P(PSTR(VERSION), sizeof(VERSION));
+
+  send_uint32(0x21, memory); // sample memory
+  send_uint32(0x23, rate);   // sample rate
+
+  bytes[0] = 0x40; // number of probes
+  bytes[1] = 32;
+  usb_send(bytes, 2);
+
+  bytes[0] = 0x41; // protocol version
+  bytes[1] = 2;
+  usb_send(bytes, 2);
+
+  bytes[0] = 0x00; // end of metadata
+  usb_send(bytes, 1);
+}
+
+static void reset(void) {
+  capture_stop();
+  sump.running = 0;
+  sump.groups = CAPTURE_GROUP_ALL;
+  sump.divider = 0;
+  sump.read_count = CAPTURE_BUFFER_SIZE;
+  sump.delay_count = CAPTURE_BUFFER_SIZE;
+  sump.trigger_mask = 0;
+  sump.trigger_value = 0;
+  sump.trigger_start = 0;
+  sump.command_length = 0;
+}
+
+// The trigger mask without the channels of groups that are not sampled.
+static uint32_t trigger_mask(void) {
+  uint32_t mask = 0;
+
+  for (uint8_t group = 0; group < 4; group++) {
+    if (sump.groups & (1 << group)) {
+      mask |= sump.trigger_mask & (0xFFUL << (group * 8));
+    }
+  }
+  return mask;
+}
+
+/** Starts a run of at most the read count, as many samples as the buffer holds
+ * for the enabled groups. With a stage 0 trigger that starts the capture, the
+ * delay count of them follow the trigger sample and the rest precede it. A
+ * trigger on no sampled channel would match at once, the run takes the samples
+ * right away then, at the higher rate of the untriggered capture.
+ */
+static void run(void) {
+  uint8_t size = capture_sample_size(sump.groups);
+  uint32_t samples = sump.read_count;
+  uint32_t after;
+  capture_mode_t mode = CAPTURE_MODE_BUFFER;
+  uint32_t rate;
+
+  if (size == 0) {
+    return;
+  }
+
+  if (samples > CAPTURE_BUFFER_SIZE / size) {
+    samples = CAPTURE_BUFFER_SIZE / size;
+  }
+
+  after = samples;
+  if (sump.trigger_start && trigger_mask() != 0) {
+    if (sump.delay_count < samples) {
+      after = sump.delay_count;
+    }
+    capture_set_trigger(trigger_mask(), sump.trigger_value, samples - after);
+    mode = CAPTURE_MODE_TRIGGER;
+  }
+
+  rate = capture_start(sump.groups, SUMP_CLOCK / (sump.divider + 1), after,
+                       mode);
+  if (rate != 0) {
+    sump.samples = samples;
+    sump.rate = rate;
+    sump.running = 1;
+  }
+}
+
+static void process_command(void) {
+  const uint8_t *data = &sump.command[1];
+
+  switch (sump.command[0]) {
+  case SUMP_RESET:
+    reset();
+    break;
+  case SUMP_RUN:
+    run();
+    break;
+  case SUMP_ID:
+    send_P(sump_id, sizeof(sump_id));
+    break;
+  case SUMP_METADATA:
+    send_metadata();
+    break;
+  case SUMP_SET_DIVIDER:
+    sump.divider = data[0] | ((uint32_t)data[1] << 8) |
+                   ((uint32_t)data[2] << 16);
+    break;
+  case SUMP_SET_READ_DELAY:
+    sump.read_count = ((data[0] | ((uint32_t)data[1] << 8)) + 1) * 4;
+    sump.delay_count = ((data[2] | ((uint32_t)data[3] << 8)) + 1) * 4;
+    break;
+  case SUMP_SET_FLAGS:
+    sump.groups = ~(data[0] >> SUMP_FLAGS_GROUPS_SHIFT) & CAPTURE_GROUP_ALL;
+    break;
+  case SUMP_SET_TRIGGER_MASK:
+    sump.trigger_mask = get_uint32(data);
+    break;
+  case SUMP_SET_TRIGGER_VALUE:
+    sump.trigger_value = get_uint32(data);
+    break;
+  case SUMP_SET_TRIGGER_CONFIG:
+    // only a parallel trigger on level 0 that starts the capture, the delay
+    // of the stage is not supported
+    sump.trigger_start = (data[3] & SUMP_TRIGGER_START) != 0;
+    break;
+  default:
+    // XON/XOFF and the trigger stages 1 to 3 are accepted but not used
+    break;
+  }
+}
+
+void sump_enter(void) {
+  reset();
+  sump.samples = 0;
+  sump.rate = 0;
+  sump.active = 1;
+  sump.armed = 0;
+  sump.last_dtr = usb_host_ready();
+}
+
+uint8_t sump_active(void) { return sump.active; }
+
+void sump_putc(uint8_t byte) {
+  sump.command[sump.command_length++] = byte;
+
+  if (sump.command[0] < SUMP_LONG_COMMAND ||
+      sump.command_length == SUMP_COMMAND_SIZE) {
+    process_command();
+    sump.command_length = 0;
+  }
+}
+
+/** Sends a finished capture and leaves SUMP mode once the front end has closed
+ * the port. Called from the main loop.
+ */
+void sump_task(void) {
+  uint8_t dtr;
+
+  if (!sump.active) {
+    return;
+  }
+
+  if (sump.running && capture_get_state() != CAPTURE_RUNNING) {
+    uint8_t size = capture_sample_size(sump.groups);
+    uint16_t length;
+    const uint8_t *samples = capture_get_buffer(&length);
+    uint16_t first = 0;
+
+    // a trigger run may have more samples before the trigger than asked for
+    if (length > sump.samples * size) {
+      first = length - sump.samples * size;
+    }
+
+    // SUMP sends the newest sample first
+    while (length >= first + size) {
+      length -= size;
+      usb_send(&samples[length], size);
+    }
+    sump.running = 0;
+  }
+
+  dtr = usb_host_ready();
+  if (dtr && !sump.last_dtr) {
+    sump.armed = 1;
+  } else if (!dtr && sump.last_dtr && sump.armed) {
+    reset();
+    sump.active = 0;
+  }
+  sump.last_dtr = dtr;
+}
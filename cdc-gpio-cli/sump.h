@@ -0,0 +1,27 @@
+#ifndef _SUMP_H_
+#define _SUMP_H_
+
+#include <stdint.h>
+
+/*
+ * SUMP/OLS logic analyzer protocol on the CDC port, so standard front ends
+ * (OpenBench Logic Sniffer client, sigrok/PulseView "ols" driver) can drive
+ * the capture engine. The four channel groups of capture.h are SUMP groups 0
+ * to 3. Each run fills the sample buffer from the timer interrupt and sends it
+ * newest sample first, as SUMP expects. The value/mask trigger of stage 0 is
+ * supported, the run then keeps sampling into the buffer as a ring until it
+ * matches.
+ *
+ * `capture sump` switches the port to this protocol. It is switched back to
+ * the text CLI when the front end closes the port, detected as DTR dropping
+ * after it was raised again in SUMP mode.
+ */
+
+#define SUMP_CLOCK 100000000UL // the reference clock of the SUMP divider
+
+void sump_enter(void);
+uint8_t sump_active(void);
+void sump_putc(uint8_t byte);
+void sump_task(void);
+
+#endif // _SUMP_H_
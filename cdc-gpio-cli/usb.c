@@ -1,8 +1,42 @@
 #include <LUFA/Drivers/USB/USB.h>
+#include <util/atomic.h>
 
 #include "usb.h"
 
-static FILE usb_stdio_stream;
+#define USB_RING_NEXT(index, size) ((uint8_t)((index) + 1) & ((size)-1))
+#define USB_RING_COUNT(head, tail, size) ((uint8_t)((head) - (tail)) & ((size)-1))
+
+#if (USB_RX_BUFFER_SIZE & (USB_RX_BUFFER_SIZE - 1)) ||                        \
+    (USB_RX_BUFFER_SIZE > 256) || (USB_RX_BUFFER_SIZE <= CDC_TXRX_EPSIZE)
+#error "USB_RX_BUFFER_SIZE must be a power of two in (CDC_TXRX_EPSIZE, 256]"
+#endif
+
+#if (USB_TX_BUFFER_SIZE & (USB_TX_BUFFER_SIZE - 1)) ||                        \
+    (USB_TX_BUFFER_SIZE > 256) || (USB_TX_BUFFER_SIZE < 2)
+#error "USB_TX_BUFFER_SIZE must be a power of two in [2, 256]"
+#endif
+
+// The RX ring is filled by the USB endpoint interrupt and drained by the main
+// loop, the TX ring the other way round. Each index is only written by one
+// side.
+static uint8_t rx_buffer[USB_RX_BUFFER_SIZE];
+static volatile uint8_t rx_head;
+static volatile uint8_t rx_tail;
+static uint8_t tx_buffer[USB_TX_BUFFER_SIZE];
+static volatile uint8_t tx_head;
+static volatile uint8_t tx_tail;
+
+static volatile uint8_t rx_throttled; // the OUT interrupt is off, ring full
+static uint8_t tx_zlp_pending;
+static volatile uint8_t tx_hold;     // a command is producing output
+static volatile uint8_t tx_flushing; // usb_flush() wants everything out now
+static volatile uint8_t tx_direct;   // the class driver owns the IN endpoint
+static volatile uint8_t tx_waiting;  // a partial packet waits for more output
+static uint8_t tx_hold_frames;       // frames a partial packet has waited
+static uint16_t tx_hold_packets;     // packets sent since the hold began
+static uint8_t tx_reply_pending;     // a reply is still leaving the TX ring
+static uint8_t tx_reply_end;         // tx_head when the reply was released
+static usb_stats_t stats;
 
 static const USB_Descriptor_Device_t PROGMEM device_descriptor = {
     .Header = {.Size = sizeof(USB_Descriptor_Device_t), .Type = DTYPE_Device},
@@ -158,13 +192,13 @@ static USB_ClassInfo_CDC_Device_t cdc_interface = {
                 {
                     .Address = CDC_TX_EPADDR,
                     .Size = CDC_TXRX_EPSIZE,
-                    .Banks = 1,
+                    .Banks = CDC_TXRX_BANKS,
                 },
             .DataOUTEndpoint =
                 {
                     .Address = CDC_RX_EPADDR,
                     .Size = CDC_TXRX_EPSIZE,
-                    .Banks = 1,
+                    .Banks = CDC_TXRX_BANKS,
                 },
             .NotificationEndpoint =
                 {
@@ -215,24 +249,406 @@ uint16_t CALLBACK_USB_GetDescriptor(const uint16_t value, const uint16_t index,
   return size;
 }
 
+// Turns an interrupt of the UEIENX register of an endpoint on or off. The
+// caller keeps interrupts off, and selects the endpoint it needs afterwards.
+static void usb_endpoint_interrupt(uint8_t address, uint8_t bit,
+                                   uint8_t enable) {
+  Endpoint_SelectEndpoint(address);
+  if (enable) {
+    UEIENX |= _BV(bit);
+  } else {
+    UEIENX &= ~_BV(bit);
+  }
+}
+
+/** Moves every complete OUT packet into the RX ring. A packet that does not fit
+ * is left in its bank, so the host is NAKed until the main loop catches up,
+ * and the OUT interrupt is turned off until usb_rx_resume() finds room.
+ */
+static void usb_service_rx(void) {
+  Endpoint_SelectEndpoint(CDC_RX_EPADDR);
+
+  while (Endpoint_IsOUTReceived()) {
+    uint8_t head = rx_head;
+    uint8_t length = Endpoint_BytesInEndpoint();
+    uint8_t space = USB_RX_BUFFER_SIZE - 1 -
+                    USB_RING_COUNT(head, rx_tail, USB_RX_BUFFER_SIZE);
+
+    if (length > space) {
+      if (!rx_throttled) {
+        rx_throttled = 1;
+        stats.rx_overflows++;
+      }
+      UEIENX &= ~_BV(RXOUTE);
+      break;
+    }
+
+    for (uint8_t i = 0; i < length; i++) {
+      rx_buffer[head] = Endpoint_Read_8();
+      head = USB_RING_NEXT(head, USB_RX_BUFFER_SIZE);
+    }
+
+    Endpoint_ClearOUT();
+    rx_head = head;
+    rx_throttled = 0;
+    stats.rx_bytes += length;
+  }
+}
+
+// Lets the main loop take bytes out of the RX ring until there is room for a
+// whole packet again, then turns the OUT interrupt back on.
+static void usb_rx_resume(void) {
+  if (rx_throttled && USB_RX_BUFFER_SIZE - 1 - usb_available() >=
+                          CDC_TXRX_EPSIZE) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      uint8_t endpoint = Endpoint_GetCurrentEndpoint();
+
+      usb_endpoint_interrupt(CDC_RX_EPADDR, RXOUTE, 1);
+      Endpoint_SelectEndpoint(endpoint);
+    }
+  }
+}
+
+// While a command holds the output, a packet that would not be full waits
+// for more of its output, up to USB_TX_COALESCE_MS frames. Only then are
+// start of frame events on, to count the frames and send the packet.
+static uint8_t usb_tx_wait(uint8_t count) {
+  if (!tx_hold || tx_flushing || count >= CDC_TXRX_EPSIZE ||
+      tx_hold_frames >= USB_TX_COALESCE_MS) {
+    if (tx_waiting) {
+      tx_waiting = 0;
+      tx_hold_frames = 0;
+      USB_Device_DisableSOFEvents();
+    }
+    return 0;
+  }
+  if (!tx_waiting) {
+    tx_waiting = 1;
+    USB_Device_EnableSOFEvents();
+  }
+  return 1;
+}
+
+// Counts a packet in the stats only if it carries a reply. While a command
+// holds the output it is not yet known to be one, so those packets are kept
+// aside until usb_tx_release().
+static void usb_tx_count(void) {
+  if (tx_reply_pending) {
+    stats.tx_packets++;
+  } else if (tx_hold) {
+    tx_hold_packets++;
+  }
+}
+
+/** Fills every free IN bank from the TX ring. A packet of exactly
+ * CDC_TXRX_EPSIZE bytes is followed by a zero length packet once the ring runs
+ * dry, so the host does not wait for more data to complete the transfer.
+ *
+ * The IN interrupt stays on only while the ring has a packet to send, as the
+ * hardware raises it for as long as a bank is free.
+ */
+static void usb_service_tx(void) {
+  uint8_t armed = !tx_direct;
+
+  Endpoint_SelectEndpoint(CDC_TX_EPADDR);
+
+  while (armed && Endpoint_IsINReady()) {
+    uint8_t head = tx_head;
+    uint8_t tail = tx_tail;
+    uint8_t length = 0;
+    uint8_t reply_left;
+
+    if (head == tail) {
+      if (tx_zlp_pending) {
+        tx_zlp_pending = 0;
+        Endpoint_ClearIN();
+        usb_tx_count();
+        tx_reply_pending = 0;
+      }
+      armed = 0;
+      break;
+    }
+
+    if (usb_tx_wait(USB_RING_COUNT(head, tail, USB_TX_BUFFER_SIZE))) {
+      armed = 0;
+      break;
+    }
+
+    while (tail != head && length < CDC_TXRX_EPSIZE) {
+      Endpoint_Write_8(tx_buffer[tail]);
+      tail = USB_RING_NEXT(tail, USB_TX_BUFFER_SIZE);
+      length++;
+    }
+
+    Endpoint_ClearIN();
+    // the reply is out with the packet that reaches tx_reply_end, or with the
+    // zero length packet after it
+    reply_left = USB_RING_COUNT(tx_reply_end, tx_tail, USB_TX_BUFFER_SIZE);
+    if (reply_left == 0) {
+      tx_reply_pending = 0;
+    }
+    usb_tx_count();
+    if (length >= reply_left) {
+      tx_reply_pending = tx_reply_pending && tail == head &&
+                         length == CDC_TXRX_EPSIZE;
+    }
+    tx_tail = tail;
+    tx_zlp_pending = (length == CDC_TXRX_EPSIZE);
+    stats.tx_bytes += length;
+  }
+
+  usb_endpoint_interrupt(CDC_TX_EPADDR, TXINE, armed);
+}
+
+// Turns the IN interrupt on, so the endpoint takes what is in the TX ring.
+static void usb_tx_kick(void) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    uint8_t endpoint = Endpoint_GetCurrentEndpoint();
+
+    usb_endpoint_interrupt(CDC_TX_EPADDR, TXINE, 1);
+    Endpoint_SelectEndpoint(endpoint);
+  }
+}
+
+static uint16_t usb_queue(const uint8_t *data, uint16_t len) {
+  uint8_t head = tx_head;
+  uint16_t written = 0;
+
+  while (written < len) {
+    uint8_t next = USB_RING_NEXT(head, USB_TX_BUFFER_SIZE);
+    if (next == tx_tail) {
+      break;
+    }
+    tx_buffer[head] = data[written++];
+    head = next;
+  }
+
+  tx_head = head;
+  // a partial packet that is being held waits for the start of frame handler,
+  // unless this completes it
+  if (written > 0 &&
+      (!tx_waiting || USB_RING_COUNT(head, tx_tail, USB_TX_BUFFER_SIZE) >=
+                          CDC_TXRX_EPSIZE)) {
+    usb_tx_kick();
+  }
+  return written;
+}
+
 void usb_init(void) {
   USB_Init();
-  CDC_Device_CreateStream(&cdc_interface, &usb_stdio_stream);
-  stdout = &usb_stdio_stream;
-  stdin = &usb_stdio_stream;
 }
 
 void usb_disable(void) { USB_Disable(); }
 
-void usb_task(void) {
-  CDC_Device_USBTask(&cdc_interface);
-  USB_USBTask();
+uint8_t usb_available(void) {
+  return USB_RING_COUNT(rx_head, rx_tail, USB_RX_BUFFER_SIZE);
 }
 
-int16_t usb_read_byte(void) { return CDC_Device_ReceiveByte(&cdc_interface); }
+int16_t usb_read_byte(void) {
+  uint8_t tail = rx_tail;
+  uint8_t value;
+
+  if (tail == rx_head) {
+    return -1;
+  }
+
+  value = rx_buffer[tail];
+  rx_tail = USB_RING_NEXT(tail, USB_RX_BUFFER_SIZE);
+  usb_rx_resume();
+  return value;
+}
+
+uint8_t usb_read(void *data, uint8_t len) {
+  uint8_t *bytes = data;
+  uint8_t tail = rx_tail;
+  uint8_t head = rx_head;
+  uint8_t count = 0;
+
+  while (count < len && tail != head) {
+    bytes[count++] = rx_buffer[tail];
+    tail = USB_RING_NEXT(tail, USB_RX_BUFFER_SIZE);
+  }
+
+  rx_tail = tail;
+  usb_rx_resume();
+  return count;
+}
 
 uint8_t usb_write_byte(uint8_t byte) {
-  return CDC_Device_SendByte(&cdc_interface, byte);
+  return (usb_write(&byte, 1) == 1) ? 0 : 1;
+}
+
+/** Hands the IN endpoint to the LUFA class driver once the TX ring is empty,
+ * for usb_direct_write_byte(). Only usb bench uses it, to measure the per-byte
+ * CDC_Device_SendByte() path the CLI used before the rings against them.
+ * Returns non-zero if the ring could not be flushed.
+ */
+uint8_t usb_direct_begin(void) {
+  if (usb_flush()) {
+    return 1;
+  }
+  tx_direct = 1;
+  return 0;
+}
+
+/** Sends one byte with CDC_Device_SendByte(), between usb_direct_begin() and
+ * usb_direct_end().
+ */
+uint8_t usb_direct_write_byte(uint8_t byte) {
+  return CDC_Device_SendByte(&cdc_interface, byte) !=
+         ENDPOINT_READYWAIT_NoError;
+}
+
+/** Sends the last partial bank and gives the IN endpoint back to the TX ring.
+ */
+uint8_t usb_direct_end(void) {
+  uint8_t result =
+      CDC_Device_Flush(&cdc_interface) != ENDPOINT_READYWAIT_NoError;
+
+  tx_direct = 0;
+  usb_tx_kick();
+  return result;
+}
+
+/** Queues as much of a buffer as fits into the TX ring without waiting, and
+ * returns the number of bytes taken. The USB interrupt packs them into whole
+ * endpoint banks.
+ */
+uint16_t usb_write(const void *data, uint16_t len) {
+  uint16_t written = usb_queue(data, len);
+
+  if (written < len) {
+    stats.tx_overflows++;
+  }
+  return written;
+}
+
+/** Queues a whole buffer, waiting for the USB interrupt to make room. Gives up
+ * if the device is not configured or the host takes nothing for
+ * USB_TX_TIMEOUT_MS, e.g. because no terminal has the port open.
+ */
+uint8_t usb_send(const void *data, uint16_t len) {
+  const uint8_t *bytes = data;
+  uint16_t frame = 0;
+  uint16_t idle = 0;
+
+  usb_elapsed_ms(&frame);
+
+  while (len > 0) {
+    uint16_t written;
+
+    if (USB_DeviceState != DEVICE_STATE_Configured) {
+      return 1;
+    }
+
+    written = usb_queue(bytes, len);
+    bytes += written;
+    len -= written;
+
+    if (written > 0) {
+      idle = 0;
+      usb_elapsed_ms(&frame);
+    } else if ((idle += usb_elapsed_ms(&frame)) > USB_TX_TIMEOUT_MS) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/** Waits until the USB interrupt has moved the whole TX ring into the
+ * endpoint banks.
+ */
+uint8_t usb_flush(void) {
+  uint16_t frame = 0;
+  uint16_t idle = 0;
+  uint8_t pending = USB_RING_COUNT(tx_head, tx_tail, USB_TX_BUFFER_SIZE);
+  uint8_t result = 0;
+
+  usb_elapsed_ms(&frame);
+  tx_flushing = 1;
+  usb_tx_kick();
+
+  while (pending > 0) {
+    uint8_t remaining;
+
+    if (USB_DeviceState != DEVICE_STATE_Configured) {
+      result = 1;
+      break;
+    }
+
+    remaining = USB_RING_COUNT(tx_head, tx_tail, USB_TX_BUFFER_SIZE);
+    if (remaining < pending) {
+      idle = 0;
+      usb_elapsed_ms(&frame);
+    } else if ((idle += usb_elapsed_ms(&frame)) > USB_TX_TIMEOUT_MS) {
+      result = 1;
+      break;
+    }
+    pending = remaining;
+  }
+
+  tx_flushing = 0;
+  return result;
+}
+
+/** Holds back partly filled IN packets until usb_tx_release(), so the output
+ * of one command leaves in as few packets as it fits. Full packets still go
+ * out as soon as a bank is free, and a partial one waits at most
+ * USB_TX_COALESCE_MS.
+ */
+void usb_tx_hold(void) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    tx_hold = 1;
+    tx_hold_frames = 0;
+    tx_hold_packets = 0;
+  }
+}
+
+/** Ends a usb_tx_hold() and sends the rest of the output at once. When
+ * \p reply is set a command ran during the hold, its output counts as a reply
+ * in the stats, with the packets sent so far and those that still carry it.
+ */
+void usb_tx_release(uint8_t reply) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    tx_hold = 0;
+    if (reply) {
+      stats.replies++;
+      stats.tx_packets += tx_hold_packets;
+      tx_reply_end = tx_head;
+      tx_reply_pending = (tx_head != tx_tail) || tx_zlp_pending;
+    }
+  }
+  usb_tx_kick();
+}
+
+/** Returns 1 while the host has the port open, i.e. DTR is set. */
+uint8_t usb_host_ready(void) {
+  return (cdc_interface.State.ControlLineStates.HostToDevice &
+          CDC_CONTROL_LINE_OUT_DTR) != 0;
+}
+
+/** Returns 1 while the host has suspended the bus. LUFA has then frozen the
+ * USB clock and turned the PLL off, and the USB wake-up interrupt brings it
+ * back even from power-down.
+ */
+uint8_t usb_suspended(void) {
+  return USB_DeviceState == DEVICE_STATE_Suspended;
+}
+
+void usb_get_stats(usb_stats_t *result) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { *result = stats; }
+}
+
+/** Returns the milliseconds elapsed since the USB frame number stored in
+ * \p frame and updates it. The frame counter is only 11 bits wide, so this
+ * must be called at least once every two seconds to accumulate longer spans.
+ */
+uint16_t usb_elapsed_ms(uint16_t *frame) {
+  uint16_t now = USB_Device_GetFrameNumber();
+  uint16_t elapsed = (now - *frame) & 0x07FF;
+
+  *frame = now;
+  return elapsed;
 }
 
 /** Event handler for the library USB Connection event. */
@@ -242,12 +658,71 @@ void EVENT_USB_Device_Connect(void) {
 
 /** Event handler for the library USB Disconnection event. */
 void EVENT_USB_Device_Disconnect(void) {
-  // do nothing
+  // drop whatever the host will never read
+  tx_tail = tx_head;
+  tx_zlp_pending = 0;
+  tx_reply_pending = 0;
 }
 
-/** Event handler for the library USB Configuration Changed event. */
+/** Event handler for the library USB Reset event. The control endpoint has
+ * just been set up again, SETUP packets are handled by USB_COM_vect.
+ */
+void EVENT_USB_Device_Reset(void) {
+  usb_endpoint_interrupt(ENDPOINT_CONTROLEP, RXSTPE, 1);
+}
+
+/** Event handler for the library USB Configuration Changed event. Configuring
+ * the data endpoints clears their interrupt enables, the OUT one goes on for
+ * good and the IN one sends whatever was queued before.
+ */
 void EVENT_USB_Device_ConfigurationChanged(void) {
   CDC_Device_ConfigureEndpoints(&cdc_interface);
+  rx_throttled = 0;
+  tx_waiting = 0;
+  tx_hold_frames = 0;
+  USB_Device_DisableSOFEvents();
+  usb_endpoint_interrupt(CDC_RX_EPADDR, RXOUTE, 1);
+  usb_endpoint_interrupt(CDC_TX_EPADDR, TXINE, 1);
+}
+
+/** Event handler for the library USB Start of Frame event. Start of frame
+ * events are only on while a partial IN packet is held back, this counts the
+ * frames it has waited and sends it after USB_TX_COALESCE_MS.
+ */
+void EVENT_USB_Device_StartOfFrame(void) {
+  uint8_t endpoint = Endpoint_GetCurrentEndpoint();
+
+  if (tx_waiting) {
+    tx_hold_frames++;
+    usb_service_tx();
+  }
+  Endpoint_SelectEndpoint(endpoint);
+}
+
+/** USB endpoint interrupt, in place of the one LUFA has with
+ * INTERRUPT_CONTROL_ENDPOINT. The CDC data endpoints are serviced as soon as
+ * an OUT packet arrives or an IN bank is free, instead of once per frame.
+ * SETUP packets are handled as LUFA does it, with interrupts on again, so
+ * a slow control request does not hold up the data endpoints or the timers.
+ */
+ISR(USB_COM_vect, ISR_BLOCK) {
+  uint8_t endpoint = Endpoint_GetCurrentEndpoint();
+  uint8_t pending = UEINT;
+
+  if (pending & _BV(CDC_RX_EPADDR & ENDPOINT_EPNUM_MASK)) {
+    usb_service_rx();
+  }
+  if (pending & _BV(CDC_TX_EPADDR & ENDPOINT_EPNUM_MASK)) {
+    usb_service_tx();
+  }
+  if (pending & _BV(ENDPOINT_CONTROLEP)) {
+    usb_endpoint_interrupt(ENDPOINT_CONTROLEP, RXSTPE, 0);
+    GlobalInterruptEnable();
+    USB_Device_ProcessControlRequest();
+    GlobalInterruptDisable();
+    usb_endpoint_interrupt(ENDPOINT_CONTROLEP, RXSTPE, 1);
+  }
+  Endpoint_SelectEndpoint(endpoint);
 }
 
 /** Event handler for the library USB Control Request reception event. */
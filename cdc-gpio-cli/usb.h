@@ -11,7 +11,41 @@
 #define CDC_TX_EPADDR (ENDPOINT_DIR_IN | 3)
 #define CDC_RX_EPADDR (ENDPOINT_DIR_OUT | 4)
 #define CDC_NOTIFICATION_EPSIZE 8
-#define CDC_TXRX_EPSIZE 16
+
+// The data endpoints are 64 bytes (the largest bulk packet at full speed) and
+// double banked, so one bank can be filled while the host reads the other.
+#ifndef CDC_TXRX_EPSIZE
+#define CDC_TXRX_EPSIZE 64
+#endif
+#ifndef CDC_TXRX_BANKS
+#define CDC_TXRX_BANKS 2
+#endif
+
+// Sizes of the SRAM rings between the CDC data endpoints and the application,
+// both must be a power of two no larger than 256.
+#ifndef USB_RX_BUFFER_SIZE
+#define USB_RX_BUFFER_SIZE 128
+#endif
+#ifndef USB_TX_BUFFER_SIZE
+#define USB_TX_BUFFER_SIZE 256
+#endif
+
+// The rate the raw stream is sized for, both IN banks once per millisecond.
+// The IN interrupt refills a bank as soon as the host has read it, so the
+// host may take more in a frame, this is the figure that is always met.
+#define USB_TX_MAX_RATE ((uint32_t)CDC_TXRX_EPSIZE * CDC_TXRX_BANKS * 1000)
+
+// How long a blocking send waits for the host to take any data.
+#ifndef USB_TX_TIMEOUT_MS
+#define USB_TX_TIMEOUT_MS 100
+#endif
+
+// How long a partly filled IN packet may wait for more output of the same
+// command before it is sent anyway, in frames of one millisecond. 0 sends
+// whatever the TX ring holds as soon as an IN bank is free.
+#ifndef USB_TX_COALESCE_MS
+#define USB_TX_COALESCE_MS 2
+#endif
 
 typedef struct {
   USB_Descriptor_Configuration_Header_t config;
@@ -29,6 +63,15 @@ typedef struct {
   USB_Descriptor_Endpoint_t cdc_data_in_endpoint;
 } usb_descriptor_configuration_t;
 
+typedef struct {
+  uint32_t rx_bytes;
+  uint32_t tx_bytes;
+  uint32_t tx_packets;   // IN packets carrying replies, zero length included
+  uint32_t replies;      // main loop passes that ran a command
+  uint16_t rx_overflows; // OUT packets held back because the RX ring was full
+  uint16_t tx_overflows; // usb_write() calls truncated by a full TX ring
+} usb_stats_t;
+
 enum InterfaceDescriptors_t {
   INTERFACE_ID_CDC_CCI = 0, /**< CDC CCI interface descriptor ID */
   INTERFACE_ID_CDC_DCI = 1, /**< CDC DCI interface descriptor ID */
@@ -49,8 +92,21 @@ uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
 
 void usb_init(void);
 void usb_disable(void);
-void usb_task(void);
+uint8_t usb_available(void);
 int16_t usb_read_byte(void);
+uint8_t usb_read(void *data, uint8_t len);
 uint8_t usb_write_byte(uint8_t byte);
+uint8_t usb_direct_begin(void);
+uint8_t usb_direct_write_byte(uint8_t byte);
+uint8_t usb_direct_end(void);
+uint16_t usb_write(const void *data, uint16_t len);
+uint8_t usb_send(const void *data, uint16_t len);
+uint8_t usb_flush(void);
+void usb_tx_hold(void);
+void usb_tx_release(uint8_t reply);
+uint8_t usb_host_ready(void);
+uint8_t usb_suspended(void);
+void usb_get_stats(usb_stats_t *result);
+uint16_t usb_elapsed_ms(uint16_t *frame);
 
 #endif // _USB_H_
\ No newline at end of file
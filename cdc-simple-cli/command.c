@@ -1,7 +1,9 @@
+#include <avr/pgmspace.h>
 #include <avr/wdt.h>
-#include <stdio.h>
 
 #include "command.h"
+#include "out.h"
+#include "timebase.h"
 #include "usb.h"
 #include "version.h"
 
@@ -13,17 +15,29 @@ static void command_help(mcucli_t *cli, void *user_data, int argc,
                          char *argv[]);
 static void command_version(mcucli_t *cli, void *user_data,
                             int argc, char *argv[]);
+static void command_time(mcucli_t *cli, void *user_data, int argc,
+                         char *argv[]);
 static void command_reboot(mcucli_t *cli, void *user_data, int argc,
                            char *argv[]);
 static void command_bootloader(mcucli_t *cli, void *user_data,
                                int argc, char *argv[]);
 
+// The help texts are only ever printed by this file, so they stay in flash and
+// the command table only holds their addresses.
+static const char help_help[] PROGMEM = "Print this help message";
+static const char help_version[] PROGMEM = "Print the firmware version";
+static const char help_time[] PROGMEM =
+    "Print the microsecond timebase and the cycles one read of it takes";
+static const char help_reboot[] PROGMEM = "Reboot the MCU";
+static const char help_bootloader[] PROGMEM = "Enter the bootloader";
+
 static mcucli_command_t commands[] = {
-    {"help", "Print this help message", command_help},
-    {"?", "Print this help message", command_help},
-    {"version", "Print the firmware version", command_version},
-    {"reboot", "Reboot the MCU", command_reboot},
-    {"bootloader", "Enter the bootloader", command_bootloader},
+    {"help", help_help, command_help},
+    {"?", help_help, command_help},
+    {"version", help_version, command_version},
+    {"time", help_time, command_time},
+    {"reboot", help_reboot, command_reboot},
+    {"bootloader", help_bootloader, command_bootloader},
 };
 
 static mcucli_command_set_t command_set = {
@@ -38,20 +52,29 @@ static mcucli_buffer_t buffer = {line_buffer, LINE_BUFFER_SIZE, argument_buffer,
 static void unknown_command(mcucli_t *cli, void *user_data, const char *command) {
   UNUSED(cli);
   UNUSED(user_data);
-  printf("Unknown command: %s\r\n", command);
+  out_fmt_P(PSTR("Unknown command: %s\r\n"), command);
 }
 
 static void command_help(mcucli_t *cli, void *user_data, int argc,
                          char *argv[]) {
   for (size_t i = 0; i < command_set.num_commands; i++) {
-    printf("- %s\r\n", command_set.commands[i].name);
-    printf("%s\r\n\r\n", command_set.commands[i].help);
+    out_P(PSTR("- "));
+    out_str(command_set.commands[i].name);
+    out_P(PSTR("\r\n"));
+    out_line_P(command_set.commands[i].help);
+    out_P(PSTR("\r\n"));
   }
 }
 
 static void command_version(mcucli_t *cli, void *user_data,
                             int argc, char *argv[]) {
-  printf("Firmware version: %s\r\n", VERSION);
+  out_line_P(PSTR("Firmware version: " VERSION));
+}
+
+static void command_time(mcucli_t *cli, void *user_data, int argc,
+                         char *argv[]) {
+  out_fmt_P(PSTR("time: %lu us\r\n"), timebase_micros());
+  out_fmt_P(PSTR("read cost: %u cycles\r\n"), timebase_read_cost());
 }
 
 static void command_reboot(mcucli_t *cli, void *user_data, int argc,
@@ -64,6 +87,7 @@ static void command_reboot(mcucli_t *cli, void *user_data, int argc,
 
 static void command_bootloader(mcucli_t *cli, void *user_data,
                                int argc, char *argv[]) {
+  timebase_stop();
   usb_disable();
 
   /* Relocate the interrupt vector table */
@@ -75,5 +99,7 @@ static void command_bootloader(mcucli_t *cli, void *user_data,
 }
 
 void command_init(mcucli_t *cli, bytes_write_t write) {
+  // replies take the same way out as the CLI's echo and prompt
+  out_init(write);
   mcucli_init(cli, NULL, &buffer, &command_set, write, unknown_command);
 }
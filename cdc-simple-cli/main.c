@@ -6,13 +6,12 @@
 #include <string.h>
 
 #include "command.h"
+#include "timebase.h"
 #include "usb.h"
 
 static int usb_puts(const char *s, size_t len) {
-  for (size_t i = 0; i < len; i++) {
-    if (usb_write_byte(s[i]) != 0) {
-      return -1;
-    }
+  if (usb_send(s, len) != 0) {
+    return -1;
   }
   return len;
 }
@@ -23,6 +22,9 @@ static void hardware_init(void) {
   MCUSR &= ~(1 << WDRF);
   wdt_disable();
 
+  // start the microsecond timebase
+  timebase_init();
+
   // init lufa usb CDC device
   usb_init();
 }
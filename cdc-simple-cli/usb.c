@@ -2,8 +2,6 @@
 
 #include "usb.h"
 
-static FILE usb_stdio_stream;
-
 static const USB_Descriptor_Device_t PROGMEM device_descriptor = {
     .Header = {.Size = sizeof(USB_Descriptor_Device_t), .Type = DTYPE_Device},
 
@@ -217,9 +215,6 @@ uint16_t CALLBACK_USB_GetDescriptor(const uint16_t value, const uint16_t index,
 
 void usb_init(void) {
   USB_Init();
-  CDC_Device_CreateStream(&cdc_interface, &usb_stdio_stream);
-  stdout = &usb_stdio_stream;
-  stdin = &usb_stdio_stream;
 }
 
 void usb_disable(void) { USB_Disable(); }
@@ -235,6 +230,13 @@ uint8_t usb_write_byte(uint8_t byte) {
   return CDC_Device_SendByte(&cdc_interface, byte);
 }
 
+/** Writes a whole buffer into the IN endpoint bank, one endpoint selection
+ * for all of it instead of one per byte.
+ */
+uint8_t usb_send(const void *data, uint16_t len) {
+  return CDC_Device_SendData(&cdc_interface, data, len);
+}
+
 /** Event handler for the library USB Connection event. */
 void EVENT_USB_Device_Connect(void) {
   // do nothing
@@ -52,5 +52,6 @@ void usb_disable(void);
 void usb_task(void);
 int16_t usb_read_byte(void);
 uint8_t usb_write_byte(uint8_t byte);
+uint8_t usb_send(const void *data, uint16_t len);
 
 #endif // _USB_H_
\ No newline at end of file
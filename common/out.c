@@ -0,0 +1,171 @@
+#include <avr/pgmspace.h>
+#include <stdarg.h>
+
+#include "out.h"
+
+// The digits of a 32 bit number in base 10, the longest it gets.
+#define OUT_DIGITS 10
+
+static out_write_t out_write;
+static char buffer[OUT_BUFFER_SIZE];
+static uint8_t length;
+
+void out_init(out_write_t write) {
+  out_write = write;
+  length = 0;
+}
+
+void out_flush(void) {
+  if (length > 0 && out_write != NULL) {
+    out_write(buffer, length);
+  }
+  length = 0;
+}
+
+static void put(char c) {
+  buffer[length++] = c;
+  if (c == '\n' || length == sizeof(buffer)) {
+    out_flush();
+  }
+}
+
+void out_str(const char *s) {
+  while (*s != '\0') {
+    put(*s++);
+  }
+}
+
+void out_P(const char *s) {
+  char c;
+
+  while ((c = pgm_read_byte(s++)) != '\0') {
+    put(c);
+  }
+}
+
+static char hex_digit(uint8_t nibble, char ten) {
+  return (nibble < 10) ? '0' + nibble : ten + nibble - 10;
+}
+
+// Writes value in base 10 or 16, padded to width. Values that fit 16 bits
+// take the 16 bit division, several times cheaper than the 32 bit one.
+static void put_number(uint32_t value, uint8_t base, char ten, uint8_t width,
+                       char pad) {
+  char digits[OUT_DIGITS];
+  uint8_t count = 0;
+
+  if (base == 16) {
+    do {
+      digits[count++] = hex_digit(value & 0x0F, ten);
+      value >>= 4;
+    } while (value != 0);
+  } else {
+    while (value > 0xFFFF) {
+      digits[count++] = '0' + value % 10;
+      value /= 10;
+    }
+
+    uint16_t small = value;
+
+    do {
+      digits[count++] = '0' + small % 10;
+      small /= 10;
+    } while (small != 0);
+  }
+
+  while (width > count) {
+    put(pad);
+    width--;
+  }
+  while (count > 0) {
+    put(digits[--count]);
+  }
+}
+
+static void put_signed(int32_t value, uint8_t width, char pad) {
+  if (value < 0) {
+    put('-');
+    put_number(-(uint32_t)value, 10, 'A', width, pad);
+  } else {
+    put_number(value, 10, 'A', width, pad);
+  }
+}
+
+void out_char(char c) { put(c); }
+
+void out_line_P(const char *s) {
+  out_P(s);
+  put('\r');
+  put('\n');
+}
+
+void out_hex8(uint8_t value) {
+  put(hex_digit(value >> 4, 'A'));
+  put(hex_digit(value & 0x0F, 'A'));
+}
+
+void out_dec(uint32_t value) { put_number(value, 10, 'A', 0, ' '); }
+
+void out_int(int32_t value) { put_signed(value, 0, ' '); }
+
+void out_fmt_P(const char *format, ...) {
+  va_list args;
+  char c;
+
+  va_start(args, format);
+  while ((c = pgm_read_byte(format++)) != '\0') {
+    uint8_t width = 0;
+    uint8_t wide = 0;
+    char pad = ' ';
+    uint32_t value;
+
+    if (c != '%') {
+      put(c);
+      continue;
+    }
+
+    c = pgm_read_byte(format++);
+    if (c == '0') {
+      pad = '0';
+      c = pgm_read_byte(format++);
+    }
+    while (c >= '0' && c <= '9') {
+      width = width * 10 + c - '0';
+      c = pgm_read_byte(format++);
+    }
+    if (c == 'l') {
+      wide = 1;
+      c = pgm_read_byte(format++);
+    }
+
+    switch (c) {
+    case 'c':
+      put(va_arg(args, int));
+      break;
+    case 's':
+      out_str(va_arg(args, const char *));
+      break;
+    case 'S':
+      out_P(va_arg(args, const char *));
+      break;
+    case 'd':
+      put_signed(wide ? va_arg(args, int32_t) : va_arg(args, int), width, pad);
+      break;
+    case 'u':
+    case 'x':
+    case 'X':
+      value = wide ? va_arg(args, uint32_t) : va_arg(args, unsigned int);
+      put_number(value, (c == 'u') ? 10 : 16, (c == 'x') ? 'a' : 'A', width,
+                 pad);
+      break;
+    case '\0':
+      // a lone % ends the template
+      format--;
+      break;
+    default:
+      put(c);
+      break;
+    }
+  }
+  va_end(args);
+}
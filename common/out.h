@@ -0,0 +1,36 @@
+#ifndef _OUT_H_
+#define _OUT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Replies are collected in a buffer of this size, which is handed to the write
+// function at every line end and whenever it fills up, so output of the CLI,
+// which always ends its lines, never waits for out_flush().
+#ifndef OUT_BUFFER_SIZE
+#define OUT_BUFFER_SIZE 32
+#endif
+
+// Takes len bytes of output, the same shape as the CLI's write function.
+typedef int (*out_write_t)(const char *s, size_t len);
+
+void out_init(out_write_t write);
+void out_flush(void);
+
+/* Fast paths, no format string to parse. */
+void out_char(char c);
+void out_str(const char *s);
+void out_P(const char *s);
+void out_line_P(const char *s);
+void out_hex8(uint8_t value);
+void out_dec(uint32_t value);
+void out_int(int32_t value);
+
+/*
+ * Fixed reply templates from flash, a subset of printf: %c, %s, %S for a
+ * string in flash, %d, %u, %x and %X, all with an optional l for 32 bits and
+ * an optional width with 0 or space padding, and %%.
+ */
+void out_fmt_P(const char *format, ...);
+
+#endif // _OUT_H_
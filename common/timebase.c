@@ -0,0 +1,71 @@
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+#include "timebase.h"
+
+// Reads per timebase_read_cost() measurement.
+#define TIMEBASE_COST_READS 1024
+
+static volatile uint32_t overflows;
+static volatile uint8_t sequence; // changes whenever overflows does
+
+ISR(TIMER0_OVF_vect) {
+  overflows++;
+  sequence++;
+}
+
+void timebase_init(void) {
+  TCCR0A = 0;
+  TCNT0 = 0;
+  TIFR0 = _BV(TOV0);
+  TIMSK0 = _BV(TOIE0);
+  TCCR0B = _BV(CS01);
+}
+
+/** Stops timer 0 and its interrupt, e.g. before jumping to the bootloader. */
+void timebase_stop(void) {
+  TIMSK0 = 0;
+  TCCR0B = 0;
+}
+
+/** Microseconds since timebase_init(), safe to call from the main loop and
+ * from interrupt handlers without disabling interrupts. A read the overflow
+ * interrupt cut into is retried, so the counter and its overflow count always
+ * belong together. An overflow still pending when called from a handler is
+ * added by hand, for a count that has already wrapped to a small value.
+ */
+uint32_t timebase_micros(void) {
+  uint32_t high;
+  uint8_t count;
+  uint8_t pending;
+  uint8_t seen;
+
+  do {
+    seen = sequence;
+    high = overflows;
+    count = TCNT0;
+    pending = TIFR0 & _BV(TOV0);
+  } while (seen != sequence);
+
+  if (pending && count < 0x80) {
+    high++;
+  }
+  return high * TIMEBASE_OVERFLOW_US + (count >> TIMEBASE_TICK_SHIFT);
+}
+
+/** Measures the cycles one timebase_micros() call takes, loop included, from
+ * the timebase itself over a run of calls long enough to make its resolution
+ * negligible.
+ */
+uint16_t timebase_read_cost(void) {
+  uint32_t start = timebase_micros();
+  uint32_t elapsed;
+
+  for (uint16_t i = 0; i < TIMEBASE_COST_READS; i++) {
+    timebase_micros();
+  }
+  elapsed = timebase_micros() - start;
+
+  return (elapsed * (F_CPU / 1000000UL) + TIMEBASE_COST_READS / 2) /
+         TIMEBASE_COST_READS;
+}
@@ -0,0 +1,25 @@
+#ifndef _TIMEBASE_H_
+#define _TIMEBASE_H_
+
+#include <stdint.h>
+
+// Timer 0 counts at F_CPU / 8 and an overflow interrupt extends it to 32 bits
+// of microseconds, wrapping after about 71 minutes. The timer is not shared,
+// applications using the timebase must leave timer 0 alone.
+#if F_CPU == 16000000UL
+#define TIMEBASE_TICK_SHIFT 1 // two ticks per microsecond
+#elif F_CPU == 8000000UL
+#define TIMEBASE_TICK_SHIFT 0 // one tick per microsecond
+#else
+#error "The timebase needs F_CPU at 8 or 16 MHz"
+#endif
+
+// Microseconds per timer 0 overflow.
+#define TIMEBASE_OVERFLOW_US (256 >> TIMEBASE_TICK_SHIFT)
+
+void timebase_init(void);
+void timebase_stop(void);
+uint32_t timebase_micros(void);
+uint16_t timebase_read_cost(void);
+
+#endif // _TIMEBASE_H_
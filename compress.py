@@ -0,0 +1,90 @@
+from __future__ import print_function
+
+import argparse, os
+
+# The format the bootloader decompresses, each DNLOAD block on its own:
+#   0x00-0x7F  literal run, the next token + 1 bytes are copied as they are
+#   0x80-0xFF  match, (token & 0x7F) + 3 bytes are copied from distance d back
+#              in the output, the next byte is d - 1
+# Matches may overlap the bytes they produce, a literal 0xFF and a match at
+# distance 1 fill 130 bytes.
+WINDOW_SIZE = 256
+MIN_MATCH = 3
+MAX_MATCH = 0x7F + MIN_MATCH
+MAX_LITERALS = 0x80
+
+def longest_match(data, position):
+  best_length, best_distance = 0, 0
+  limit = min(MAX_MATCH, len(data) - position)
+  for distance in range(1, min(WINDOW_SIZE, position) + 1):
+    start = position - distance
+    length = 0
+    while length < limit and data[start + length] == data[position + length]:
+      length += 1
+    if length > best_length:
+      best_length, best_distance = length, distance
+      if length == limit:
+        break
+  return best_length, best_distance
+
+def compress(data):
+  data = bytearray(data)
+  output = bytearray()
+  literals = bytearray()
+
+  def flush_literals():
+    for i in range(0, len(literals), MAX_LITERALS):
+      run = literals[i:i + MAX_LITERALS]
+      output.append(len(run) - 1)
+      output.extend(run)
+    del literals[:]
+
+  position = 0
+  while position < len(data):
+    length, distance = longest_match(data, position)
+    if length >= MIN_MATCH:
+      flush_literals()
+      output.append(0x80 | (length - MIN_MATCH))
+      output.append(distance - 1)
+      position += length
+    else:
+      literals.append(data[position])
+      position += 1
+  flush_literals()
+  return output
+
+def decompress(data):
+  data = bytearray(data)
+  output = bytearray()
+  position = 0
+  while position < len(data):
+    token = data[position]
+    if token & 0x80:
+      distance = data[position + 1] + 1
+      for _ in range((token & 0x7F) + MIN_MATCH):
+        output.append(output[-distance])
+      position += 2
+    else:
+      output.extend(data[position + 1:position + token + 2])
+      position += token + 2
+  return output
+
+def report(image, block):
+  assert os.path.isfile(image), '{} doesn\'t exist.'.format(image)
+  with open(image, 'rb') as file:
+    data = bytearray(file.read()[:0x7000])
+  total = 0
+  for address in range(0, len(data), block):
+    chunk = data[address:address + block]
+    compressed = compress(chunk)
+    assert decompress(compressed) == chunk, 'Block 0x{:04X} doesn\'t round trip.'.format(address)
+    total += len(compressed)
+    print('0x{:04X} {:>6} {:>6}'.format(address, len(chunk), len(compressed)))
+  print('total  {:>6} {:>6} {:.1f}%'.format(len(data), total, 100.0 * total / len(data)))
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser(description='Report how well an application image compresses for the bootloader.')
+  parser.add_argument('image', type=str, help='The binary image, only its first 28KB are used.')
+  parser.add_argument('-b', '--block', type=int, default=0x1000 - 128, help='Bytes per DNLOAD block.')
+  args = parser.parse_args()
+  report(args.image, args.block)
@@ -0,0 +1,224 @@
+from __future__ import print_function
+
+import argparse, struct, time
+
+import usb.core
+
+from compress import compress
+
+VENDOR_ID = 0x03EB
+PRODUCT_ID = 0x2FF4  # ATmega32U4
+
+DFU_DNLOAD = 0x01
+DFU_UPLOAD = 0x02
+DFU_GETSTATUS = 0x03
+
+# DFU_TRANSFER_SIZE, 32 pages
+TRANSFER_SIZE = 0x1000
+
+APPLICATION_SIZE = 0x7000
+PAGE_SIZE = 128
+# FIXED_CONTROL_ENDPOINT_SIZE, the program data starts aligned to it
+CONTROL_SIZE = 32
+# Program command and filler, DFU_FILLER_BYTES_SIZE, and DFU_FILE_SUFFIX_SIZE
+HEADER_SIZE = 32
+SUFFIX_SIZE = 16
+# Image bytes per DNLOAD or UPLOAD, a page less than TRANSFER_SIZE leaves room
+# for the header and suffix
+BLOCK_SIZE = TRANSFER_SIZE - PAGE_SIZE
+# The compressed downloads and page CRCs need a bootloader built with
+# COMPRESSED_DOWNLOADS and PAGE_CRC_READS, both on in Config/AppConfig.h.
+
+# Memory type of compressed flash data, COMPRESSED_FLASH_MEMORY
+COMPRESSED_FLASH = 0x80
+# Memory type of the CRCs of the application pages, PAGE_CRC_MEMORY
+PAGE_CRC = 0x81
+
+# Read Bootloader Info index of the first statistics byte, BOOTLOADER_STATS_INDEX
+STATS_INDEX = 0x10
+# BootloaderStats_t, little endian
+STATS_FORMAT = '<BBHHHH'
+# One tick of timer 1 at clk/1024 and 16MHz, in milliseconds
+TIMER_TICK_MS = 1024 / 16000.0
+
+class Bootloader(object):
+  def __init__(self):
+    self.device = usb.core.find(idVendor=VENDOR_ID, idProduct=PRODUCT_ID)
+    assert self.device is not None, 'No DFU bootloader found.'
+    self.device.set_configuration()
+
+  def download(self, data, timeout=5000):
+    self.device.ctrl_transfer(0x21, DFU_DNLOAD, 0, 0, bytearray(data), timeout)
+
+  def upload(self, length):
+    return bytearray(self.device.ctrl_transfer(0xA1, DFU_UPLOAD, 0, 0, length))
+
+  def status(self):
+    status = self.device.ctrl_transfer(0xA1, DFU_GETSTATUS, 0, 0, 6)
+    # status, poll timeout in ms, state
+    return status[0], status[1] | (status[2] << 8) | (status[3] << 16), status[4]
+
+  def check_status(self):
+    status, timeout, state = self.status()
+    assert status == 0, 'DFU error {} in state {}.'.format(status, state)
+    # the bootloader may still be programming the last page of a block
+    time.sleep(timeout / 1000.0)
+
+  def read_info(self, index):
+    self.download([0x05, 0x00, index])
+    return self.upload(1)[0]
+
+  def stats(self):
+    size = struct.calcsize(STATS_FORMAT)
+    data = bytearray(self.read_info(STATS_INDEX + i) for i in range(size))
+    assert self.status()[0] == 0, 'Bootloader without flash statistics.'
+    erased, blank, erase_ticks, written, skipped, cleared = struct.unpack(
+        STATS_FORMAT, bytes(data))
+    return {
+        'erased pages': erased,
+        'blank pages': blank,
+        'erase ms': erase_ticks * TIMER_TICK_MS,
+        'written pages': written,
+        'skipped pages': skipped,
+        'cleared pages': cleared,
+    }
+
+  def erase(self):
+    self.download([0x04, 0x00, 0xFF])
+
+  def read(self, address, length, memory=0x00):
+    end = address + length - 1
+    self.download([0x03, memory, address >> 8, address & 0xFF, end >> 8, end & 0xFF])
+    return self.upload(length)
+
+  # The CRC of each application page as it is in flash. The bootloader
+  # computes them from the flash contents on every read, it keeps no journal of
+  # what was written, so they are right after any interruption or reset.
+  def page_crcs(self):
+    pages = APPLICATION_SIZE // PAGE_SIZE
+    data = self.read(0, pages * 2, PAGE_CRC)
+    assert len(data) == pages * 2, 'Bootloader built without PAGE_CRC_READS.'
+    return list(struct.unpack('<{}H'.format(pages), bytes(data)))
+
+  # The addresses are those of the data after decompression, when compressed
+  # is its compress() output.
+  def program(self, address, length, data, compressed=False):
+    end = address + length - 1
+    memory = COMPRESSED_FLASH if compressed else 0x00
+    command = bytearray([0x01, memory, address >> 8, address & 0xFF, end >> 8, end & 0xFF])
+    self.download(command + bytearray(HEADER_SIZE - len(command)) +
+                  bytearray(address % CONTROL_SIZE) + data + bytearray(SUFFIX_SIZE))
+    self.check_status()
+
+def print_stats(stats):
+  for name in sorted(stats):
+    value = stats[name]
+    print('{:<16} {}'.format(name, round(value, 1) if isinstance(value, float) else value))
+
+# _crc16_update() of avr-libc over the bytes, from 0xFFFF
+def crc16(data):
+  crc = 0xFFFF
+  for byte in bytearray(data):
+    crc ^= byte
+    for _ in range(8):
+      crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+  return crc
+
+# Addresses of the pages of the image whose CRCs don't match the flash. A page
+# cut off mid-write reads back different from the image and is sent again.
+def missing_pages(data, crcs):
+  return [address for address in range(0, len(data), PAGE_SIZE)
+          if crcs[address // PAGE_SIZE] != crc16(data[address:address + PAGE_SIZE])]
+
+# Contiguous runs of the pages, of at most size bytes
+def page_blocks(pages, size):
+  blocks = []
+  for address in pages:
+    if blocks and blocks[-1][0] + blocks[-1][1] == address and blocks[-1][1] + PAGE_SIZE <= size:
+      blocks[-1][1] += PAGE_SIZE
+    else:
+      blocks.append([address, PAGE_SIZE])
+  return blocks
+
+def read_image(image):
+  with open(image, 'rb') as file:
+    data = bytearray(file.read()[:APPLICATION_SIZE])
+  # whole pages, the rest of the last one erased
+  return data + b'\xFF' * (-len(data) % PAGE_SIZE)
+
+def stats(bootloader, args):
+  print_stats(bootloader.stats())
+
+def erase(bootloader, args):
+  start = time.time()
+  bootloader.erase()
+  elapsed = time.time() - start
+  print_stats(bootloader.stats())
+  print('{:<16} {}'.format('host ms', round(elapsed * 1000, 1)))
+
+def flash(bootloader, args):
+  data = read_image(args.image)
+  pages = range(0, len(data), PAGE_SIZE)
+  if args.resume:
+    pages = missing_pages(data, bootloader.page_crcs())
+  blocks = [(address, data[address:address + length])
+            for address, length in page_blocks(pages, args.block)]
+  # compressed ahead of time, like a packing step would
+  payloads = [compress(block) if args.compress else block for _, block in blocks]
+  start = time.time()
+  for (address, block), payload in zip(blocks, payloads):
+    bootloader.program(address, len(block), payload, args.compress)
+  elapsed = time.time() - start
+  print_stats(bootloader.stats())
+  print('{:<16} {}'.format('bytes', len(data)))
+  print('{:<16} {}'.format('resent pages', len(pages)))
+  print('{:<16} {}'.format('sent bytes', sum(len(payload) for payload in payloads)))
+  print('{:<16} {}'.format('host ms', round(elapsed * 1000, 1)))
+  print('{:<16} {}'.format('KB/s', round(len(data) / 1024.0 / elapsed, 1)))
+
+def progress(bootloader, args):
+  crcs = bootloader.page_crcs()
+  blank = crc16(b'\xFF' * PAGE_SIZE)
+  print('{:<16} {}'.format('used pages', sum(1 for crc in crcs if crc != blank)))
+  if args.image:
+    data = read_image(args.image)
+    missing = missing_pages(data, crcs)
+    print('{:<16} {}'.format('image pages', len(data) // PAGE_SIZE))
+    print('{:<16} {}'.format('missing pages', len(missing)))
+    for address, length in page_blocks(missing, APPLICATION_SIZE):
+      print('  0x{:04X}-0x{:04X}'.format(address, address + length - 1))
+
+def read(bootloader, args):
+  data = bytearray()
+  start = time.time()
+  for address in range(0, APPLICATION_SIZE, args.block):
+    data += bootloader.read(address, min(args.block, APPLICATION_SIZE - address))
+  elapsed = time.time() - start
+  if args.output:
+    with open(args.output, 'wb') as file:
+      file.write(data)
+  print('{:<16} {}'.format('bytes', len(data)))
+  print('{:<16} {}'.format('host ms', round(elapsed * 1000, 1)))
+  print('{:<16} {}'.format('KB/s', round(len(data) / 1024.0 / elapsed, 1)))
+
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser(description='Query the DFU bootloader.')
+  subparsers = parser.add_subparsers(dest='command')
+  subparsers.required = True
+  subparsers.add_parser('stats', help='Print the statistics of the last flash operations.').set_defaults(func=stats)
+  subparsers.add_parser('erase', help='Erase the application and report how long it took.').set_defaults(func=erase)
+  subparser = subparsers.add_parser('flash', help='Program an application image and report the transfer rate.')
+  subparser.add_argument('image', type=str, help='The binary image, only its first 28KB are programmed.')
+  subparser.add_argument('-b', '--block', type=int, default=BLOCK_SIZE, help='Bytes per DNLOAD request, a multiple of {}.'.format(PAGE_SIZE))
+  subparser.add_argument('-z', '--compress', action='store_true', help='Send the image compressed.')
+  subparser.add_argument('-r', '--resume', action='store_true', help='Only send the pages whose CRCs don\'t match the flash.')
+  subparser.set_defaults(func=flash)
+  subparser = subparsers.add_parser('progress', help='Print the pages the flash differs from an image in.')
+  subparser.add_argument('image', type=str, nargs='?', help='The binary image to list the missing pages of.')
+  subparser.set_defaults(func=progress)
+  subparser = subparsers.add_parser('read', help='Read back the application section and report the transfer rate.')
+  subparser.add_argument('-o', '--output', type=str, help='The file to save the image to.')
+  subparser.add_argument('-b', '--block', type=int, default=BLOCK_SIZE, help='Bytes per UPLOAD request.')
+  subparser.set_defaults(func=read)
+  args = parser.parse_args()
+  args.func(Bootloader(), args)
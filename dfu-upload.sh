@@ -1,5 +1,14 @@
 #!/bin/bash
 
+# Usage: dfu-upload.sh [-d] firmware
+#   -d  differential upload: no chip erase, the bootloader only rewrites the
+#       pages that changed and reports how many it wrote and skipped
+DIFFERENTIAL=0
+if [ "$1" = "-d" ]; then
+  DIFFERENTIAL=1
+  shift
+fi
+
 # Check if firmware file is provided as an argument
 if [ $# -eq 0 ]; then
   echo "Please provide the firmware file as an argument."
@@ -14,6 +23,12 @@ MCU="atmega32u4"
 FIRMWARE="$1"
 
 # Upload firmware using dfu-programmer
-dfu-programmer $MCU erase
-dfu-programmer $MCU flash $FIRMWARE
+if [ $DIFFERENTIAL -eq 1 ]; then
+  dfu-programmer $MCU flash --force $FIRMWARE
+  # The statistics are optional, dfu-tool.py needs python3 and pyusb
+  python3 "$(dirname "$0")/dfu-tool.py" stats || echo "No flash statistics."
+else
+  dfu-programmer $MCU erase
+  dfu-programmer $MCU flash $FIRMWARE
+fi
 dfu-programmer $MCU reset
@@ -0,0 +1,26 @@
+#!/bin/bash
+
+# Print the static SRAM usage of an AVR ELF file against the device budget,
+# followed by the largest objects placed in SRAM.
+
+if [ $# -eq 0 ]; then
+  echo "Usage: $0 <elf file> [sram size in bytes]"
+  exit 1
+fi
+
+ELF="$1"
+BUDGET="${2:-2560}"
+
+section_size() {
+  avr-size -A "$ELF" | awk -v name="$1" '$1 == name { print $2 }'
+}
+
+DATA=$(section_size .data)
+BSS=$(section_size .bss)
+NOINIT=$(section_size .noinit)
+USED=$((${DATA:-0} + ${BSS:-0} + ${NOINIT:-0}))
+
+echo "SRAM: $USED of $BUDGET bytes used (.data ${DATA:-0}, .bss ${BSS:-0}, .noinit ${NOINIT:-0})"
+echo "      $((BUDGET - USED)) bytes left for the stack"
+echo "Largest SRAM objects:"
+avr-nm --size-sort -r -S -t d "$ELF" | awk '$3 ~ /^[bBdD]$/ { printf "  %6d  %s\n", $2, $4 }' | head -n 15
@@ -2,10 +2,14 @@
 #include <avr/wdt.h>
 #include <stdio.h>
 
+#include "timebase.h"
+
 #define UNUSED(x) (void)(x)
 
 #define USART_BAUDRATE (57600)
+#ifndef F_CPU
 #define F_CPU (16000000UL)
+#endif
 #define USART_UBRR1H (((F_CPU / (16UL * USART_BAUDRATE)) - 1) >> 8)
 #define USART_UBRR1L ((F_CPU / (16UL * USART_BAUDRATE)) - 1)
 
@@ -46,6 +50,9 @@ static void init_hardware(void) {
   /* Set frame format: 8data, 2 stop bit */
   UCSR1C = (1 << USBS1) | (3 << UCSZ10);
 
+  /* Start the microsecond timebase */
+  timebase_init();
+
   sei();
 }
 
@@ -55,6 +62,10 @@ int main(void) {
 
   printf("Hello, World!\r\n");
 
-  while (1)
-    ;
+  /* Print the timebase for every character received */
+  while (1) {
+    getchar();
+    printf("time: %lu us, read cost: %u cycles\r\n", timebase_micros(),
+           timebase_read_cost());
+  }
 }